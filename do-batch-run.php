@@ -8,7 +8,15 @@
 $initial_warmup_time = 240; // in seconds
 $warmup_time = 120; // in seconds
 $repeat_count = 100;
-$benchmark_options = "-w ${warmup_time} -m -r ${repeat_count}";
+$calibration_time = 10; // idle power calibration, in seconds
+$cooldown_temp = 0; // package temperature to wait for before each warmup and measured phase, 0 = disabled
+// Only the classic float and int kernels. The newer families are run by hand, some need options
+// (mix needs -f) or particular hardware (AVX, AVX2, FMA, AVX-512, MSR access for license).
+$classic_prefixes = array("float-", "float32-", "floatvec-", "int-", "int32-");
+$benchmark_options = "-w ${warmup_time} -c ${calibration_time} -m -r ${repeat_count}";
+if ($cooldown_temp > 0) {
+	$benchmark_options .= " -C ${cooldown_temp}";
+}
 
 $my_dir = dirname($argv[0]);
 chdir($my_dir);
@@ -20,22 +28,31 @@ if ($argc > 1) {
 	}
 }
 
-function discover_benchmarks() {
-	$files = glob("*");
+function is_classic($name, $classic_prefixes) {
+	foreach ($classic_prefixes as $prefix) {
+		if (strncmp($name, $prefix, strlen($prefix)) === 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+function discover_benchmarks($classic_prefixes) {
+	// All benchmarks are linked into the idq-bench executable
+	$output = shell_exec("./idq-bench --list");
 	$benchmarks = array();
 	
-	foreach ($files as $file) {
-		// All executable files except for .php scripts
-		if (is_file($file) && is_executable($file) && substr($file, -4) !== ".php" && substr($file, -3) !== ".sh") {
-			$benchmarks[] = $file;
+	foreach (explode("\n", $output) as $name) {
+		if (strlen($name) > 0 && is_classic($name, $classic_prefixes)) {
+			$benchmarks[] = $name;
 		}
 	}
 	
 	return $benchmarks;
 }
 
-function do_batch_run($benchmark_options, $initial_warmup_time) {
-	$benchmarks = discover_benchmarks();
+function do_batch_run($benchmark_options, $initial_warmup_time, $classic_prefixes) {
+	$benchmarks = discover_benchmarks($classic_prefixes);
 	
 	$destination_dir = strftime("batch-runs-%Y-%m-%d_%H_%M_%S");
 	mkdir($destination_dir);
@@ -43,14 +60,14 @@ function do_batch_run($benchmark_options, $initial_warmup_time) {
 	// Initial warmup
 	if (count($benchmarks) > 0) {
 		$benchmark = $benchmarks[0];
-		shell_exec(escapeshellcmd("./${benchmark} -w ${initial_warmup_time}") . " > /dev/null");
+		shell_exec(escapeshellcmd("./idq-bench --run ${benchmark} -w ${initial_warmup_time}") . " > /dev/null");
 	}
 	
 	foreach ($benchmarks as $benchmark) {
-		shell_exec(escapeshellcmd("./${benchmark} ${benchmark_options}") . " > " . escapeshellarg("${destination_dir}/${benchmark}.csv"));
+		shell_exec(escapeshellcmd("./idq-bench --run ${benchmark} ${benchmark_options}") . " > " . escapeshellarg("${destination_dir}/idq-bench-${benchmark}.csv"));
 	}
 }
 
-do_batch_run($benchmark_options, $initial_warmup_time);
+do_batch_run($benchmark_options, $initial_warmup_time, $classic_prefixes);
 
 ?>
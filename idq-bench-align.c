@@ -0,0 +1,270 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * Special experiment: The compiled kernels are copied to executable memory at a chosen byte offset from
+ * a 64-byte boundary. Sweeping the offset with -s 0:63:+1 shows how the placement of the loop affects the
+ * DSB/MITE split and power, including the effect of the JCC erratum mitigation.
+ *
+ * Usage: ./idq-bench-align --run <name> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -s <offset from>:<to>:+<step> ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+#include "x86-reloc.h"
+
+/*
+ * Number of inner loop iterations, and elements in the data array.
+ * 1 array * 2048 elements/array * 8 bytes/element = 16 kB
+ */
+#define ARRAY_SIZE	2048
+
+/*
+ * Align arrays to a 2 MB boundary.
+ */
+#define ARRAY_ALIGNMENT	2097152
+
+/*
+ * Offsets are relative to this boundary.
+ */
+#define CODE_ALIGNMENT	64
+
+/*
+ * Loop enough times to make the power consumption measurable.
+ */
+#define NTIMES_PRNG		454000
+#define NTIMES_FLOAT_ADD	606000
+
+/* Exponential macro expansion */
+#define PRNG_1 magic = (1103515245 * magic + 12345); j++;
+#define PRNG_2 PRNG_1 PRNG_1
+#define PRNG_4 PRNG_2 PRNG_2
+#define PRNG_8 PRNG_4 PRNG_4
+#define PRNG_16 PRNG_8 PRNG_8
+
+#define ADD_1 sum += a[j]; j++;
+#define ADD_2 ADD_1 ADD_1
+#define ADD_4 ADD_2 ADD_2
+#define ADD_8 ADD_4 ADD_4
+#define ADD_16 ADD_8 ADD_8
+
+/*
+ * Benchmark kernels. Each one lives in its own section so that its code can be copied.
+ */
+static unsigned long long RELOC_KERNEL(idq_align_prng_normal) kernel_prng_normal(long ntimes, void *data) {
+	long i = 0, j = 0;
+	unsigned long long magic = 0;
+	(void)data;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE;) {
+			PRNG_8
+		}
+	}
+	return magic;
+}
+
+static unsigned long long RELOC_KERNEL(idq_align_prng_extreme) kernel_prng_extreme(long ntimes, void *data) {
+	long i = 0, j = 0;
+	unsigned long long magic = 0;
+	(void)data;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE;) {
+			PRNG_16
+		}
+	}
+	return magic;
+}
+
+static unsigned long long RELOC_KERNEL(idq_align_float_add_normal) kernel_float_add_normal(long ntimes, void *data) {
+	long i = 0, j = 0;
+	double *a = data, sum = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE;) {
+			ADD_8
+		}
+	}
+	return sum;
+}
+
+static unsigned long long RELOC_KERNEL(idq_align_float_add_extreme) kernel_float_add_extreme(long ntimes, void *data) {
+	long i = 0, j = 0;
+	double *a = data, sum = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE;) {
+			ADD_16
+		}
+	}
+	return sum;
+}
+
+RELOC_DECLARE_SECTION(idq_align_prng_normal)
+RELOC_DECLARE_SECTION(idq_align_prng_extreme)
+RELOC_DECLARE_SECTION(idq_align_float_add_normal)
+RELOC_DECLARE_SECTION(idq_align_float_add_extreme)
+
+typedef unsigned long long (*kernel_t)(long ntimes, void *data);
+
+/*
+ * Location of a compiled kernel.
+ */
+typedef struct {
+	const unsigned char *start;
+	const unsigned char *stop;
+} kernel_code_t;
+
+/*
+ * A kernel copied to a given offset.
+ */
+typedef struct {
+	unsigned char *buffer;
+	size_t size;
+	kernel_t func;
+} relocated_t;
+
+typedef struct {
+	kernel_code_t normal_code;
+	kernel_code_t extreme_code;
+	relocated_t normal;
+	relocated_t extreme;
+	double *a;
+} benchdata_t;
+
+static void unrelocate(relocated_t *rel) {
+	reloc_free(rel->buffer, rel->size);
+	memset(rel, 0, sizeof(*rel));
+}
+
+static int relocate(relocated_t *rel, const kernel_code_t *code, long offset) {
+	size_t len = code->stop - code->start;
+
+	unrelocate(rel);
+	rel->size = (len + offset + 4095) & ~(size_t)4095;
+	rel->buffer = reloc_alloc_near(rel->size, code->start);
+	if (rel->buffer == NULL) {
+		return 0;
+	}
+	if (!reloc_copy(rel->buffer + offset, code->start, len) || !reloc_protect(rel->buffer, rel->size)) {
+		return 0;
+	}
+	rel->func = (kernel_t)(rel->buffer + offset);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Copy both kernels to the requested offset from a 64-byte boundary.
+ */
+static long bench_set_param(void *benchdata, long offset) {
+	benchdata_t *data = benchdata;
+	offset %= CODE_ALIGNMENT;
+	if (!relocate(&data->normal, &data->normal_code, offset) || !relocate(&data->extreme, &data->extreme_code, offset)) {
+		return -1;
+	}
+	return offset;
+}
+
+static int bench_init_common(void **benchdata, const kernel_code_t *normal_code, const kernel_code_t *extreme_code) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	data->normal_code = *normal_code;
+	data->extreme_code = *extreme_code;
+
+	/* Allocate memory for the data array */
+	data->a = measure_aligned_alloc(ARRAY_SIZE * sizeof(*data->a), ARRAY_ALIGNMENT);
+
+	/* Fill with the data pattern selected with -d */
+	measure_fill_float_array(data->a, ARRAY_SIZE, sizeof(*data->a));
+
+	return bench_set_param(data, 0) >= 0;
+}
+
+static int bench_init_prng(void **benchdata) {
+	const kernel_code_t normal_code = { __start_idq_align_prng_normal, __stop_idq_align_prng_normal };
+	const kernel_code_t extreme_code = { __start_idq_align_prng_extreme, __stop_idq_align_prng_extreme };
+	return bench_init_common(benchdata, &normal_code, &extreme_code);
+}
+
+static int bench_init_float_add(void **benchdata) {
+	const kernel_code_t normal_code = { __start_idq_align_float_add_normal, __stop_idq_align_float_add_normal };
+	const kernel_code_t extreme_code = { __start_idq_align_float_add_extreme, __stop_idq_align_float_add_extreme };
+	return bench_init_common(benchdata, &normal_code, &extreme_code);
+}
+
+static int bench_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	return data->normal.func(ntimes, data->a);
+}
+
+static int bench_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	return data->extreme.func(ntimes, data->a);
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	unrelocate(&data->normal);
+	unrelocate(&data->extreme);
+	free(data->a);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench_prng = {
+	.name = "align-int-algo-prng",
+	.init = bench_init_prng,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = NTIMES_PRNG,
+	.set_param = bench_set_param,
+	.param_name = "code_offset",
+	.param_default = 0,
+};
+
+static measure_benchmark_t bench_float_add = {
+	.name = "align-float-array-l1-add",
+	.init = bench_init_float_add,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = NTIMES_FLOAT_ADD,
+	.set_param = bench_set_param,
+	.param_name = "code_offset",
+	.param_default = 0,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench_prng)
+MEASURE_REGISTER_BENCHMARK(bench_float_add)
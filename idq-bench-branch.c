@@ -0,0 +1,330 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * Branch prediction. The extreme version of every benchmark defeats one of the branch predictors,
+ * and the normal version executes the same branches in a predictable way.
+ *
+ * Variants:
+ *   branch-mispredict  one data-dependent conditional branch per byte of a 64 kB array. The given
+ *                      percentage of the bytes is random and the rest is zero, so about half of that
+ *                      percentage of the branches is mispredicted. The normal version runs the same
+ *                      bytes sorted, with the same number of taken branches.
+ *   branch-btb         a JIT-generated chain of the given number of taken jumps, 16 bytes apart,
+ *                      which overflows the branch target buffer beyond a few thousand jumps. The normal
+ *                      version runs a chain of 256 jumps as many times as needed for the same count.
+ *   branch-rsb         a JIT-generated chain of nested calls of the given depth, which overflows the
+ *                      16-entry return stack buffer. The normal version calls a chain of depth 8 as many
+ *                      times as needed for the same number of calls and returns. Some later generations
+ *                      predict the returns beyond the return stack buffer from the branch target buffer,
+ *                      which knows the fixed return sites of the chain and hides part of the cost.
+ *
+ * The counters collect UOPS_RETIRED:ALL, BR_MISP_RETIRED:ALL_BRANCHES and BACLEARS:ANY instead of the
+ * MITE, DSB and MS uops. The CSV rows end with the extra package energy and the extra issued but not
+ * retired uops of the extreme version per extra mispredict and per extra front-end resteer.
+ *
+ * Usage: ./idq-bench-branch --run <variant> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -s <from>:<to>[:<factor>] ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+#include "x86-jit.h"
+
+/*
+ * Number of bytes in the branch condition arrays, long enough that the global history cannot
+ * learn the random sequence.
+ */
+#define ARRAY_SIZE	65536
+
+/*
+ * Align arrays to a 2 MB boundary.
+ */
+#define ARRAY_ALIGNMENT	2097152
+
+/*
+ * Default percentage of random branch conditions.
+ */
+#define DEFAULT_RANDOM_PERCENT	100
+
+/*
+ * Taken jumps executed per outer iteration by both versions of branch-btb, the length of the
+ * normal chain and the default length of the extreme chain.
+ */
+#define JUMPS_PER_ITERATION	65536
+#define NORMAL_JUMPS		256
+#define DEFAULT_JUMPS		8192
+
+/*
+ * Calls executed per outer iteration by both versions of branch-rsb, the depth of the normal chain
+ * and the default depth of the extreme chain.
+ */
+#define CALLS_PER_ITERATION	65536
+#define NORMAL_DEPTH		8
+#define DEFAULT_DEPTH		64
+
+/*
+ * Every jump or function of a chain has a 16-byte block: a 7-byte add followed by a jump, or by a call and a return.
+ */
+#define BLOCK_BYTES	16
+
+typedef enum {
+	CHAIN_JUMP = 0, CHAIN_CALL
+} chain_t;
+
+typedef struct {
+	chain_t chain;
+	unsigned char *random_bits;
+	unsigned char *sorted_bits;
+	jit_buffer_t normal;
+	jit_buffer_t extreme;
+} benchdata_t;
+
+/*
+ * One conditional branch per byte. The assembly keeps the compiler from turning it into a cmov.
+ */
+static long branch_kernel(const unsigned char *bits, long ntimes) {
+	long sum = 0;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j++) {
+			__asm__ (
+				"test %[bit], %[bit]\n\t"
+				"jz 1f\n\t"
+				"add $1, %[sum]\n"
+				"1:"
+				: [sum] "+r" (sum)
+				: [bit] "q" (bits[j])
+				: "cc");
+		}
+	}
+	return sum;
+}
+
+static int kernel_mispredict_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	return branch_kernel(data->sorted_bits, ntimes) != 0;
+}
+
+static int kernel_mispredict_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	return branch_kernel(data->random_bits, ntimes) != 0;
+}
+
+/*
+ * Regenerate the branch conditions with the given percentage of random bytes. The sorted copy
+ * has all the ones first.
+ */
+static long bench_set_percent(void *benchdata, long percent) {
+	benchdata_t *data = benchdata;
+	long i = 0, ones = 0;
+
+	if (percent < 0 || percent > 100) {
+		return -1;
+	}
+	for (i = 0; i < ARRAY_SIZE; i++) {
+		uint64_t value = measure_rand64();
+		data->random_bits[i] = (long)((value >> 32) % 100) < percent ? value & 1 : 0;
+		ones += data->random_bits[i];
+	}
+	for (i = 0; i < ARRAY_SIZE; i++) {
+		data->sorted_bits[i] = i < ones;
+	}
+	return percent;
+}
+
+/*
+ * Generate a chain of blocks, 16 bytes each, entered from the inner loop:
+ *   jumps:  for (i = 0; i < ntimes; i++) for (j = 0; j < inner; j++) { jmp b0; b0: add; jmp b1; ... }
+ *   calls:  for (i = 0; i < ntimes; i++) for (j = 0; j < inner; j++) { call f0 } with f_k: add; call f_k+1; ret
+ */
+static int generate_kernel(jit_buffer_t *jit, chain_t chain, long length) {
+	long per_iteration = chain == CHAIN_JUMP ? JUMPS_PER_ITERATION : CALLS_PER_ITERATION;
+	long inner_iters = per_iteration / length > 0 ? per_iteration / length : 1;
+	long k = 0;
+
+	if (!jit_alloc(jit, (length * BLOCK_BYTES + 2 * 4096 + 4095) & ~4095L)) {
+		return 0;
+	}
+	jit_xor_r32_r32(jit, JIT_RAX, JIT_RAX);
+	size_t outer = jit_label(jit);
+	jit_mov_r64_imm64(jit, JIT_RCX, inner_iters);
+	size_t inner = jit_label(jit);
+
+	/* The chain starts at the first 16-byte boundary after the jump, or the call and the jump over the chain */
+	size_t start = (jit->len + 10 + BLOCK_BYTES - 1) & ~(size_t)(BLOCK_BYTES - 1);
+	size_t end = start + length * BLOCK_BYTES;
+	if (chain == CHAIN_JUMP) {
+		jit_jmp(jit, start);
+	} else {
+		jit_call(jit, start);
+		jit_jmp(jit, end);
+	}
+	for (k = 0; k < length; k++) {
+		size_t block = start + k * BLOCK_BYTES;
+		jit_nop(jit, block - jit->len);
+		jit_add_r64_imm32(jit, JIT_RAX, 1);
+		if (chain == CHAIN_JUMP) {
+			jit_jmp(jit, k + 1 < length ? block + BLOCK_BYTES : end);
+		} else {
+			if (k + 1 < length) {
+				jit_call(jit, block + BLOCK_BYTES);
+			}
+			jit_ret(jit);
+		}
+	}
+	jit_nop(jit, end - jit->len);
+	jit_dec_r64(jit, JIT_RCX);
+	jit_jnz(jit, inner);
+	jit_dec_r64(jit, JIT_RDI);
+	jit_jnz(jit, outer);
+	jit_ret(jit);
+	return jit_finalize(jit);
+}
+
+/*
+ * Regenerate the extreme kernel for the requested number of jumps or call depth.
+ */
+static long bench_set_length(void *benchdata, long length) {
+	benchdata_t *data = benchdata;
+	long max_length = data->chain == CHAIN_JUMP ? JUMPS_PER_ITERATION : CALLS_PER_ITERATION;
+
+	jit_free(&data->extreme);
+	if (length < 1 || length > max_length || !generate_kernel(&data->extreme, data->chain, length)) {
+		return -1;
+	}
+	return length;
+}
+
+static int bench_init_mispredict(void **benchdata) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	/* Allocate memory for the branch conditions */
+	data->random_bits = measure_aligned_alloc(ARRAY_SIZE, ARRAY_ALIGNMENT);
+	data->sorted_bits = measure_aligned_alloc(ARRAY_SIZE, ARRAY_ALIGNMENT);
+	return bench_set_percent(data, DEFAULT_RANDOM_PERCENT) >= 0;
+}
+
+static int bench_init_chain(void **benchdata, chain_t chain) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	data->chain = chain;
+	if (!generate_kernel(&data->normal, chain, chain == CHAIN_JUMP ? NORMAL_JUMPS : NORMAL_DEPTH)) {
+		return 0;
+	}
+	return bench_set_length(data, chain == CHAIN_JUMP ? DEFAULT_JUMPS : DEFAULT_DEPTH) > 0;
+}
+
+static int bench_init_btb(void **benchdata) {
+	return bench_init_chain(benchdata, CHAIN_JUMP);
+}
+
+static int bench_init_rsb(void **benchdata) {
+	return bench_init_chain(benchdata, CHAIN_CALL);
+}
+
+static int bench_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->normal.code)(ntimes, NULL);
+}
+
+static int bench_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->extreme.code)(ntimes, NULL);
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	free(data->random_bits);
+	free(data->sorted_bits);
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+#define BRANCH_COUNTERS { { NULL, NULL }, { "UOPS_RETIRED:ALL", "Uops retired:" }, \
+                          { "BR_MISP_RETIRED:ALL_BRANCHES", "Mispredicts:" }, { "BACLEARS:ANY", "Resteers:" } }
+
+static measure_benchmark_t bench_mispredict = {
+	.name = "branch-mispredict",
+	.init = bench_init_mispredict,
+	.normal = kernel_mispredict_normal,
+	.extreme = kernel_mispredict_extreme,
+	.cleanup = bench_cleanup,
+	.counters = BRANCH_COUNTERS,
+	.ntimes = 5000,
+	.set_param = bench_set_percent,
+	.param_name = "random_percent",
+	.param_default = 0,
+	.ops_per_iteration = ARRAY_SIZE,
+	.branch_events = 1,
+};
+
+static measure_benchmark_t bench_btb = {
+	.name = "branch-btb",
+	.init = bench_init_btb,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.counters = BRANCH_COUNTERS,
+	.ntimes = 10000,
+	.set_param = bench_set_length,
+	.param_name = "jumps",
+	.param_default = 0,
+	.ops_per_iteration = JUMPS_PER_ITERATION,
+	.branch_events = 1,
+};
+
+static measure_benchmark_t bench_rsb = {
+	.name = "branch-rsb",
+	.init = bench_init_rsb,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.counters = BRANCH_COUNTERS,
+	.ntimes = 2500,
+	.set_param = bench_set_length,
+	.param_name = "depth",
+	.param_default = 0,
+	.ops_per_iteration = CALLS_PER_ITERATION,
+	.branch_events = 1,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench_mispredict)
+MEASURE_REGISTER_BENCHMARK(bench_btb)
+MEASURE_REGISTER_BENCHMARK(bench_rsb)
@@ -0,0 +1,321 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * Every variant executes the same number of uops per outer iteration, only the encoding of the
+ * instructions differs. The normal version has a small loop body which is delivered from the uop cache,
+ * and the extreme version has a loop body which does not fit in the uop cache, so that the legacy decode
+ * pipeline (MITE) has to decode every instruction. The difference between the two shows the decoding cost
+ * of the encoding.
+ *
+ * Variants, instruction lengths in bytes for rax and r8:
+ *   decode-short       add r64, r64                   3
+ *   decode-imm32       add r64, imm32                 7
+ *   decode-lcp         add r16, imm16                 4-5, length-changing prefix
+ *   decode-nolcp       add r16, imm8                  4-5, operand size prefix without a length change
+ *   decode-prefix15    add r64, imm32 with 8 redundant segment prefixes, 15
+ *   decode-nop15       nop with operand size prefixes 15
+ *   decode-sse         pxor xmm, xmm                  4, legacy SSE encoding
+ *   decode-vex2        vpxor xmm, xmm, xmm            4, two-byte VEX prefix
+ *   decode-vex3        vpxor xmm, xmm, xmm            5, three-byte VEX prefix
+ *   decode-evex        vpxorq xmm, xmm, xmm           6, EVEX prefix, requires AVX-512VL
+ *   decode-complex     xchg r64, r64                  3, three uops which only the first decoder can handle
+ *
+ * The xor instructions can execute on three ports, so that the vector variants are limited by
+ * the front-end rather than by the execution units.
+ *
+ * The extreme loop body can be swept in instructions with -s. It is rounded up to a multiple of the
+ * 128-instruction normal body, so that both versions still execute the same number of uops.
+ *
+ * Usage: ./idq-bench-decode --run <variant> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -s <body from>:<to>[:<factor>] ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+#include "x86-jit.h"
+
+/*
+ * Fused uops executed per outer iteration by every variant, or one extreme loop body if that is larger.
+ */
+#define UOPS_PER_ITERATION	6144
+
+/*
+ * Instructions in the normal loop body, small enough for the uop cache but too large for the loop stream detector.
+ */
+#define NORMAL_BODY	128
+
+/*
+ * Default number of instructions in the extreme loop body, too large for the uop cache.
+ */
+#define DEFAULT_EXTREME_BODY	2048
+
+/*
+ * Number of independent dependency chains.
+ */
+#define CHAINS		6
+
+/*
+ * Loop structure: rdi = outer counter, rcx = inner counter, rax/rdx/r8-r11 and xmm0-5 = accumulators,
+ * xmm7 = constant.
+ */
+static const jit_reg_t chain_regs[CHAINS] = { JIT_RAX, JIT_RDX, JIT_R8, JIT_R9, JIT_R10, JIT_R11 };
+
+/*
+ * Second source operand of the vector variants. Registers below 8 keep the two-byte VEX form available.
+ */
+#define XMM_CONSTANT	7
+
+typedef enum {
+	REQUIRES_NONE = 0, REQUIRES_AVX, REQUIRES_AVX512VL
+} requires_t;
+
+typedef struct {
+	void (*emit)(jit_buffer_t *jit, int chain);
+	int uops;
+	requires_t requires;
+} variant_t;
+
+static void emit_short(jit_buffer_t *jit, int chain) {
+	jit_alu_r64_r64(jit, JIT_ALU_ADD, chain_regs[chain], chain_regs[chain]);
+}
+
+static void emit_imm32(jit_buffer_t *jit, int chain) {
+	jit_alu_r64_imm32(jit, JIT_ALU_ADD, chain_regs[chain], 0x12345);
+}
+
+static void emit_lcp(jit_buffer_t *jit, int chain) {
+	jit_alu_r16_imm16(jit, JIT_ALU_ADD, chain_regs[chain], 0x1234);
+}
+
+static void emit_nolcp(jit_buffer_t *jit, int chain) {
+	jit_alu_r16_imm8(jit, JIT_ALU_ADD, chain_regs[chain], 0x12);
+}
+
+static void emit_prefix15(jit_buffer_t *jit, int chain) {
+	int i = 0;
+	for (i = 0; i < 8; i++) {
+		/* DS segment override, ignored in 64-bit mode */
+		jit_emit_u8(jit, 0x3e);
+	}
+	jit_alu_r64_imm32(jit, JIT_ALU_ADD, chain_regs[chain], 0x12345);
+}
+
+static void emit_nop15(jit_buffer_t *jit, int chain) {
+	(void)chain;
+	jit_nop_single(jit, 15);
+}
+
+static void emit_sse(jit_buffer_t *jit, int chain) {
+	jit_sse_packed_xmm_xmm(jit, JIT_SSE_PXOR, chain, XMM_CONSTANT);
+}
+
+static void emit_vex2(jit_buffer_t *jit, int chain) {
+	jit_vex_packed_xmm_xmm(jit, JIT_SSE_PXOR, chain, chain, XMM_CONSTANT, 0);
+}
+
+static void emit_vex3(jit_buffer_t *jit, int chain) {
+	jit_vex_packed_xmm_xmm(jit, JIT_SSE_PXOR, chain, chain, XMM_CONSTANT, 1);
+}
+
+static void emit_evex(jit_buffer_t *jit, int chain) {
+	jit_evex_packed_xmm_xmm(jit, JIT_SSE_PXOR, chain, chain, XMM_CONSTANT);
+}
+
+/* Swap within three independent register pairs */
+static void emit_complex(jit_buffer_t *jit, int chain) {
+	int pair = chain % (CHAINS / 2);
+	jit_xchg_r64_r64(jit, chain_regs[2 * pair], chain_regs[2 * pair + 1]);
+}
+
+static const variant_t variant_short = { emit_short, 1, REQUIRES_NONE };
+static const variant_t variant_imm32 = { emit_imm32, 1, REQUIRES_NONE };
+static const variant_t variant_lcp = { emit_lcp, 1, REQUIRES_NONE };
+static const variant_t variant_nolcp = { emit_nolcp, 1, REQUIRES_NONE };
+static const variant_t variant_prefix15 = { emit_prefix15, 1, REQUIRES_NONE };
+static const variant_t variant_nop15 = { emit_nop15, 1, REQUIRES_NONE };
+static const variant_t variant_sse = { emit_sse, 1, REQUIRES_NONE };
+static const variant_t variant_vex2 = { emit_vex2, 1, REQUIRES_AVX };
+static const variant_t variant_vex3 = { emit_vex3, 1, REQUIRES_AVX };
+static const variant_t variant_evex = { emit_evex, 1, REQUIRES_AVX512VL };
+static const variant_t variant_complex = { emit_complex, 3, REQUIRES_NONE };
+
+/*
+ * Generate the kernel: for (i = 0; i < ntimes; i++) for (j = 0; j < inner_iters; j++) { body }
+ * The body has the requested number of instructions rotating over the chains.
+ */
+static int generate_kernel(jit_buffer_t *jit, const variant_t *variant, long body, long inner_iters) {
+	long k = 0;
+	int chain = 0;
+
+	/* 15 bytes is the longest x86 instruction */
+	if (!jit_alloc(jit, (body * 15 + 4096 + 4095) & ~4095L)) {
+		return 0;
+	}
+
+	/* Distinct non-zero start values, 1.0 + chain in the xmm registers */
+	for (chain = 0; chain < CHAINS; chain++) {
+		double value = 1.0 + chain;
+		uint64_t bits = 0;
+		memcpy(&bits, &value, sizeof(bits));
+		jit_mov_r64_imm64(jit, chain_regs[chain], bits);
+		jit_movq_xmm_r64(jit, chain, chain_regs[chain]);
+		jit_mov_r64_imm64(jit, chain_regs[chain], chain + 1);
+	}
+	jit_movq_xmm_r64(jit, XMM_CONSTANT, JIT_RAX);
+
+	size_t outer = jit_label(jit);
+	jit_mov_r64_imm64(jit, JIT_RCX, inner_iters);
+	size_t inner = jit_label(jit);
+	for (k = 0; k < body; k++) {
+		variant->emit(jit, k % CHAINS);
+	}
+	jit_dec_r64(jit, JIT_RCX);
+	jit_jnz(jit, inner);
+	jit_dec_r64(jit, JIT_RDI);
+	jit_jnz(jit, outer);
+
+	for (chain = 1; chain < CHAINS; chain++) {
+		jit_add_r64_r64(jit, JIT_RAX, chain_regs[chain]);
+	}
+	if (variant->requires != REQUIRES_NONE) {
+		/* Avoid SSE transition penalties in the code running after the kernel */
+		jit_vzeroupper(jit);
+	}
+	jit_ret(jit);
+	return jit_finalize(jit);
+}
+
+typedef struct {
+	const variant_t *variant;
+	jit_buffer_t normal;
+	jit_buffer_t extreme;
+} benchdata_t;
+
+/*
+ * Regenerate both kernels for the requested number of instructions in the extreme loop body. The body
+ * is rounded up to a multiple of the normal body, so that the normal version can execute exactly as
+ * many instructions per outer iteration as the extreme version.
+ */
+static long bench_set_param(void *benchdata, long body) {
+	benchdata_t *data = benchdata;
+
+	if (body < 1) {
+		return -1;
+	}
+	body = (body + NORMAL_BODY - 1) / NORMAL_BODY * NORMAL_BODY;
+	long insns_per_iteration = UOPS_PER_ITERATION / data->variant->uops;
+	long extreme_iters = insns_per_iteration / body > 0 ? insns_per_iteration / body : 1;
+
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	if (!generate_kernel(&data->normal, data->variant, NORMAL_BODY, extreme_iters * body / NORMAL_BODY) ||
+	    !generate_kernel(&data->extreme, data->variant, body, extreme_iters)) {
+		return -1;
+	}
+	return body;
+}
+
+/*
+ * Instruction set extension the variant needs but the CPU lacks, or NULL. The variant is skipped without it.
+ */
+static const char *variant_missing_feature(const variant_t *variant) {
+	if (variant->requires == REQUIRES_AVX && !__builtin_cpu_supports("avx")) {
+		return "AVX";
+	}
+	if (variant->requires == REQUIRES_AVX512VL && !__builtin_cpu_supports("avx512vl")) {
+		return "AVX-512VL";
+	}
+	return NULL;
+}
+
+static int bench_init_variant(void **benchdata, const variant_t *variant) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	data->variant = variant;
+	return bench_set_param(data, DEFAULT_EXTREME_BODY) > 0;
+}
+
+static int bench_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->normal.code)(ntimes, NULL);
+}
+
+static int bench_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->extreme.code)(ntimes, NULL);
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration. The iteration count is tuned for the extreme version.
+ */
+#define DECODE_BENCHMARK(variant, bench_name, bench_ntimes) \
+	static int bench_init_##variant(void **benchdata) { \
+		return bench_init_variant(benchdata, &variant_##variant); \
+	} \
+	static const char *bench_missing_feature_##variant(void) { \
+		return variant_missing_feature(&variant_##variant); \
+	} \
+	static measure_benchmark_t bench_##variant = { \
+		.name = bench_name, \
+		.init = bench_init_##variant, \
+		.normal = bench_normal, \
+		.extreme = bench_extreme, \
+		.cleanup = bench_cleanup, \
+		.ntimes = bench_ntimes, \
+		.set_param = bench_set_param, \
+		.param_name = "body_insns", \
+		.param_default = 0, \
+		.missing_feature = bench_missing_feature_##variant, \
+	}; \
+	MEASURE_REGISTER_BENCHMARK(bench_##variant)
+
+DECODE_BENCHMARK(short, "decode-short", 1000000)
+DECODE_BENCHMARK(imm32, "decode-imm32", 1000000)
+DECODE_BENCHMARK(lcp, "decode-lcp", 130000)
+DECODE_BENCHMARK(nolcp, "decode-nolcp", 1000000)
+DECODE_BENCHMARK(prefix15, "decode-prefix15", 500000)
+DECODE_BENCHMARK(nop15, "decode-nop15", 500000)
+DECODE_BENCHMARK(sse, "decode-sse", 1100000)
+DECODE_BENCHMARK(vex2, "decode-vex2", 1100000)
+DECODE_BENCHMARK(vex3, "decode-vex3", 1100000)
+DECODE_BENCHMARK(evex, "decode-evex", 1200000)
+DECODE_BENCHMARK(complex, "decode-complex", 750000)
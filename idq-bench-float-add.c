@@ -1,7 +1,9 @@
 /*
  * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture. Compiled with GCC 4.4.
  *
- * Usage: ./idq-bench-float-add [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ]
+ * The sum is split into the number of independent accumulators given with -A.
+ *
+ * Usage: ./idq-bench-float-add [ -A <accumulators> ] [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ]
  *
  * Author: Mikael Hirki <mikael.hirki@gmail.com>
  *
@@ -49,45 +51,69 @@
  */
 typedef double kernel_data_t;
 
-/* Exponential macro expansion */
-#define ADD_1 sum += a; j++;
-#define ADD_2 ADD_1 ADD_1
-#define ADD_4 ADD_2 ADD_2
-#define ADD_8 ADD_4 ADD_4
-#define ADD_16 ADD_8 ADD_8
-#define ADD_32 ADD_16 ADD_16
-#define ADD_64 ADD_32 ADD_32
-#define ADD_128 ADD_64 ADD_64
-#define ADD_256 ADD_128 ADD_128
-#define ADD_512 ADD_256 ADD_256
-#define ADD_1024 ADD_512 ADD_512
-#define ADD_2048 ADD_1024 ADD_1024
+/* Exponential macro expansion, k is the position in the unrolled body */
+#define ADD_1(k) sum[(k) % acc] += a; j++;
+#define ADD_2(k) ADD_1(k) ADD_1((k) + 1)
+#define ADD_4(k) ADD_2(k) ADD_2((k) + 2)
+#define ADD_8(k) ADD_4(k) ADD_4((k) + 4)
+#define ADD_16(k) ADD_8(k) ADD_8((k) + 8)
+#define ADD_32(k) ADD_16(k) ADD_16((k) + 16)
+#define ADD_64(k) ADD_32(k) ADD_32((k) + 32)
+#define ADD_128(k) ADD_64(k) ADD_64((k) + 64)
+#define ADD_256(k) ADD_128(k) ADD_128((k) + 128)
+#define ADD_512(k) ADD_256(k) ADD_256((k) + 256)
+#define ADD_1024(k) ADD_512(k) ADD_512((k) + 512)
+#define ADD_2048(k) ADD_1024(k) ADD_1024((k) + 1024)
 
 /*
- * Benchmark kernels
+ * Benchmark kernels with acc accumulators, inlined with a constant acc
  */
-kernel_data_t kernel_normal(long ntimes, kernel_data_t a, kernel_data_t b) {
-	(void)b;
+static inline __attribute__((always_inline)) kernel_data_t kernel_normal_acc(long ntimes, kernel_data_t a, const int acc) {
 	long i = 0, j = 0;
-	kernel_data_t sum = 0;
+	kernel_data_t sum[MEASURE_MAX_ACCUMULATORS];
+	int k = 0;
+	/* Distinct initial values, so that the compiler cannot merge the accumulators */
+	for (k = 0; k < acc; k++) {
+		sum[k] = k;
+	}
 	for (i = 0; i < ntimes; i++) {
 		for (j = 0; j < ARRAY_SIZE;) {
-			ADD_512
+			ADD_512(0)
 		}
 	}
-	return sum;
+	for (k = 1; k < acc; k++) {
+		sum[0] += sum[k];
+	}
+	return sum[0];
 }
 
-kernel_data_t kernel_extreme(long ntimes, kernel_data_t a, kernel_data_t b) {
-	(void)b;
+static inline __attribute__((always_inline)) kernel_data_t kernel_extreme_acc(long ntimes, kernel_data_t a, const int acc) {
 	long i = 0, j = 0;
-	kernel_data_t sum = 0;
+	kernel_data_t sum[MEASURE_MAX_ACCUMULATORS];
+	int k = 0;
+	/* Distinct initial values, so that the compiler cannot merge the accumulators */
+	for (k = 0; k < acc; k++) {
+		sum[k] = k;
+	}
 	for (i = 0; i < ntimes; i++) {
 		for (j = 0; j < ARRAY_SIZE;) {
-			ADD_1024
+			ADD_1024(0)
 		}
 	}
-	return sum;
+	for (k = 1; k < acc; k++) {
+		sum[0] += sum[k];
+	}
+	return sum[0];
+}
+
+static kernel_data_t kernel_normal(long ntimes, kernel_data_t a, kernel_data_t b) {
+	(void)b;
+	return MEASURE_CALL_ACCUMULATORS(kernel_normal_acc, ntimes, a);
+}
+
+static kernel_data_t kernel_extreme(long ntimes, kernel_data_t a, kernel_data_t b) {
+	(void)b;
+	return MEASURE_CALL_ACCUMULATORS(kernel_extreme_acc, ntimes, a);
 }
 
 typedef struct {
@@ -123,16 +149,17 @@ static int bench_cleanup(void *benchdata) {
 	return 1;
 }
 
-int main(int argc, char **argv) {
-	measure_benchmark_t bench;
-	memset(&bench, 0, sizeof(bench));
-
-	/* Set up benchmark parameters */
-	bench.ntimes = NTIMES;
-	bench.init = bench_init;
-	bench.normal = bench_normal;
-	bench.extreme = bench_extreme;
-	bench.cleanup = bench_cleanup;
-
-	return measure_main(argc, argv, &bench);
-}
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench = {
+	.name = "float-add",
+	.init = bench_init,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = NTIMES,
+	.max_accumulators = MEASURE_MAX_ACCUMULATORS,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench)
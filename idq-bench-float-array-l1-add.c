@@ -73,7 +73,7 @@ typedef double kernel_data_t;
 /*
  * Benchmark kernels
  */
-kernel_data_t kernel_normal(long ntimes, kernel_data_t *a) {
+static kernel_data_t kernel_normal(long ntimes, kernel_data_t *a) {
 	long i = 0, j = 0;
 	kernel_data_t sum = 0;
 	for (i = 0; i < ntimes; i++) {
@@ -84,7 +84,7 @@ kernel_data_t kernel_normal(long ntimes, kernel_data_t *a) {
 	return sum;
 }
 
-kernel_data_t kernel_extreme(long ntimes, kernel_data_t *a) {
+static kernel_data_t kernel_extreme(long ntimes, kernel_data_t *a) {
 	long i = 0, j = 0;
 	kernel_data_t sum = 0;
 	for (i = 0; i < ntimes; i++) {
@@ -103,21 +103,12 @@ static int bench_init(void **benchdata) {
 	benchdata_t *data = calloc(1, sizeof(benchdata_t));
 	*benchdata = data;
 	kernel_data_t *a = NULL;
-	long i = 0;
 
 	/* Allocate memory for the data arrays */
 	data->a = a = measure_aligned_alloc(NUM_ARRAYS * ARRAY_SIZE * sizeof(kernel_data_t), ARRAY_ALIGNMENT);
 
-	/* Fill with random numbers */
-	if (arg_use_64bit_numbers) {
-		for (i = 0; i < NUM_ARRAYS * ARRAY_SIZE; i++) {
-			a[i] = rand64();
-		}
-	} else {
-		for (i = 0; i < NUM_ARRAYS * ARRAY_SIZE; i++) {
-			a[i] = (float)rand();
-		}
-	}
+	/* Fill with the data pattern selected with -d */
+	measure_fill_float_array(a, NUM_ARRAYS * ARRAY_SIZE, sizeof(kernel_data_t));
 
 	/* Success */
 	return 1;
@@ -142,16 +133,16 @@ static int bench_cleanup(void *benchdata) {
 	return 1;
 }
 
-int main(int argc, char **argv) {
-	measure_benchmark_t bench;
-	memset(&bench, 0, sizeof(bench));
-
-	/* Set up benchmark parameters */
-	bench.ntimes = NTIMES;
-	bench.init = bench_init;
-	bench.normal = bench_normal;
-	bench.extreme = bench_extreme;
-	bench.cleanup = bench_cleanup;
-
-	return measure_main(argc, argv, &bench);
-}
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench = {
+	.name = "float-array-l1-add",
+	.init = bench_init,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = NTIMES,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench)
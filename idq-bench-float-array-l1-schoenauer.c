@@ -1,7 +1,9 @@
 /*
  * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture. Compiled with GCC 4.4.
  *
- * Usage: ./idq-bench-float-array-l1-schoenauer [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ]
+ * The sum is split into the number of independent accumulators given with -A.
+ *
+ * Usage: ./idq-bench-float-array-l1-schoenauer [ -A <accumulators> ] [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ]
  *
  * Author: Mikael Hirki <mikael.hirki@gmail.com>
  *
@@ -56,43 +58,67 @@
  */
 typedef double kernel_data_t;
 
-/* Exponential macro expansion */
-#define ADD_1 sum += a[j] + b[j] * c[j]; j++;
-#define ADD_2 ADD_1 ADD_1
-#define ADD_4 ADD_2 ADD_2
-#define ADD_8 ADD_4 ADD_4
-#define ADD_16 ADD_8 ADD_8
-#define ADD_32 ADD_16 ADD_16
-#define ADD_64 ADD_32 ADD_32
-#define ADD_128 ADD_64 ADD_64
-#define ADD_256 ADD_128 ADD_128
-#define ADD_512 ADD_256 ADD_256
-#define ADD_1024 ADD_512 ADD_512
-#define ADD_2048 ADD_1024 ADD_1024
+/* Exponential macro expansion, k is the position in the unrolled body */
+#define ADD_1(k) sum[(k) % acc] += a[j] + b[j] * c[j]; j++;
+#define ADD_2(k) ADD_1(k) ADD_1((k) + 1)
+#define ADD_4(k) ADD_2(k) ADD_2((k) + 2)
+#define ADD_8(k) ADD_4(k) ADD_4((k) + 4)
+#define ADD_16(k) ADD_8(k) ADD_8((k) + 8)
+#define ADD_32(k) ADD_16(k) ADD_16((k) + 16)
+#define ADD_64(k) ADD_32(k) ADD_32((k) + 32)
+#define ADD_128(k) ADD_64(k) ADD_64((k) + 64)
+#define ADD_256(k) ADD_128(k) ADD_128((k) + 128)
+#define ADD_512(k) ADD_256(k) ADD_256((k) + 256)
+#define ADD_1024(k) ADD_512(k) ADD_512((k) + 512)
+#define ADD_2048(k) ADD_1024(k) ADD_1024((k) + 1024)
 
 /*
- * Benchmark kernels
+ * Benchmark kernels with acc accumulators, inlined with a constant acc
  */
-kernel_data_t kernel_normal(long ntimes, kernel_data_t *a, kernel_data_t *b, kernel_data_t *c) {
+static inline __attribute__((always_inline)) kernel_data_t kernel_normal_acc(long ntimes, kernel_data_t *a, kernel_data_t *b, kernel_data_t *c, const int acc) {
 	long i = 0, j = 0;
-	kernel_data_t sum = 0;
+	kernel_data_t sum[MEASURE_MAX_ACCUMULATORS];
+	int k = 0;
+	/* Distinct initial values, so that the compiler cannot merge the accumulators */
+	for (k = 0; k < acc; k++) {
+		sum[k] = k;
+	}
 	for (i = 0; i < ntimes; i++) {
 		for (j = 0; j < ARRAY_SIZE;) {
-			ADD_128
+			ADD_128(0)
 		}
 	}
-	return sum;
+	for (k = 1; k < acc; k++) {
+		sum[0] += sum[k];
+	}
+	return sum[0];
 }
 
-kernel_data_t kernel_extreme(long ntimes, kernel_data_t *a, kernel_data_t *b, kernel_data_t *c) {
+static inline __attribute__((always_inline)) kernel_data_t kernel_extreme_acc(long ntimes, kernel_data_t *a, kernel_data_t *b, kernel_data_t *c, const int acc) {
 	long i = 0, j = 0;
-	kernel_data_t sum = 0;
+	kernel_data_t sum[MEASURE_MAX_ACCUMULATORS];
+	int k = 0;
+	/* Distinct initial values, so that the compiler cannot merge the accumulators */
+	for (k = 0; k < acc; k++) {
+		sum[k] = k;
+	}
 	for (i = 0; i < ntimes; i++) {
 		for (j = 0; j < ARRAY_SIZE;) {
-			ADD_256
+			ADD_256(0)
 		}
 	}
-	return sum;
+	for (k = 1; k < acc; k++) {
+		sum[0] += sum[k];
+	}
+	return sum[0];
+}
+
+static kernel_data_t kernel_normal(long ntimes, kernel_data_t *a, kernel_data_t *b, kernel_data_t *c) {
+	return MEASURE_CALL_ACCUMULATORS(kernel_normal_acc, ntimes, a, b, c);
+}
+
+static kernel_data_t kernel_extreme(long ntimes, kernel_data_t *a, kernel_data_t *b, kernel_data_t *c) {
+	return MEASURE_CALL_ACCUMULATORS(kernel_extreme_acc, ntimes, a, b, c);
 }
 
 typedef struct {
@@ -105,23 +131,14 @@ static int bench_init(void **benchdata) {
 	benchdata_t *data = calloc(1, sizeof(benchdata_t));
 	*benchdata = data;
 	kernel_data_t *a = NULL;
-	long i = 0;
 
 	/* Allocate memory for the data arrays */
 	data->a = a = measure_aligned_alloc(NUM_ARRAYS * ARRAY_SIZE * sizeof(kernel_data_t), ARRAY_ALIGNMENT);
 	data->b = data->a + ARRAY_SIZE;
 	data->c = data->b + ARRAY_SIZE;
 
-	/* Fill with random numbers */
-	if (arg_use_64bit_numbers) {
-		for (i = 0; i < NUM_ARRAYS * ARRAY_SIZE; i++) {
-			a[i] = rand64();
-		}
-	} else {
-		for (i = 0; i < NUM_ARRAYS * ARRAY_SIZE; i++) {
-			a[i] = (float)rand();
-		}
-	}
+	/* Fill with the data pattern selected with -d */
+	measure_fill_float_array(a, NUM_ARRAYS * ARRAY_SIZE, sizeof(kernel_data_t));
 
 	/* Success */
 	return 1;
@@ -146,16 +163,17 @@ static int bench_cleanup(void *benchdata) {
 	return 1;
 }
 
-int main(int argc, char **argv) {
-	measure_benchmark_t bench;
-	memset(&bench, 0, sizeof(bench));
-
-	/* Set up benchmark parameters */
-	bench.ntimes = NTIMES;
-	bench.init = bench_init;
-	bench.normal = bench_normal;
-	bench.extreme = bench_extreme;
-	bench.cleanup = bench_cleanup;
-
-	return measure_main(argc, argv, &bench);
-}
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench = {
+	.name = "float-array-l1-schoenauer",
+	.init = bench_init,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = NTIMES,
+	.max_accumulators = MEASURE_MAX_ACCUMULATORS,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench)
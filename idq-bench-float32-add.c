@@ -66,7 +66,7 @@ typedef float kernel_data_t;
 /*
  * Benchmark kernels
  */
-kernel_data_t kernel_normal(long ntimes, kernel_data_t a, kernel_data_t b) {
+static kernel_data_t kernel_normal(long ntimes, kernel_data_t a, kernel_data_t b) {
 	(void)b;
 	long i = 0, j = 0;
 	kernel_data_t sum = 0;
@@ -78,7 +78,7 @@ kernel_data_t kernel_normal(long ntimes, kernel_data_t a, kernel_data_t b) {
 	return sum;
 }
 
-kernel_data_t kernel_extreme(long ntimes, kernel_data_t a, kernel_data_t b) {
+static kernel_data_t kernel_extreme(long ntimes, kernel_data_t a, kernel_data_t b) {
 	(void)b;
 	long i = 0, j = 0;
 	kernel_data_t sum = 0;
@@ -123,16 +123,16 @@ static int bench_cleanup(void *benchdata) {
 	return 1;
 }
 
-int main(int argc, char **argv) {
-	measure_benchmark_t bench;
-	memset(&bench, 0, sizeof(bench));
-
-	/* Set up benchmark parameters */
-	bench.ntimes = NTIMES;
-	bench.init = bench_init;
-	bench.normal = bench_normal;
-	bench.extreme = bench_extreme;
-	bench.cleanup = bench_cleanup;
-
-	return measure_main(argc, argv, &bench);
-}
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench = {
+	.name = "float32-add",
+	.init = bench_init,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = NTIMES,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench)
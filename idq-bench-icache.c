@@ -0,0 +1,265 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * Code footprints beyond the L1 instruction cache. The extreme version executes straight-line code whose
+ * size can be swept with -s from L2 to L3 and DRAM sizes, and the normal version executes the same
+ * instructions from a footprint which fits in the L1 instruction cache, repeated so that both execute
+ * the same number of bytes of code per outer iteration. The swept size is rounded up to a multiple of
+ * the 16 kB normal footprint.
+ *
+ * Variants:
+ *   icache-flat        dense straight-line code, as in large flat production binaries
+ *   itlb-sparse        one 64-byte block of code per 4 kB page, chained with jumps, so that every
+ *                      block needs its own iTLB entry. The block offset within the page rotates so
+ *                      that the blocks do not conflict in the same instruction cache set.
+ *
+ * The third and fourth counters collect ICACHE:MISSES and ITLB_MISSES:WALK_COMPLETED instead of the
+ * DSB and MS uops, so the idq_dsb and idq_ms columns hold these events.
+ *
+ * Usage: ./idq-bench-icache --run <variant> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -s <code bytes from>:<to>[:<factor>] ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+#include "x86-jit.h"
+
+/*
+ * Code size of the normal version, fits in the 32 kB L1 instruction cache.
+ */
+#define NORMAL_CODE_BYTES	16384
+
+/*
+ * Default code size of the extreme version, fits in the L3 cache but not in L2.
+ */
+#define DEFAULT_CODE_BYTES	1048576
+
+/*
+ * The extreme version executes at least this many bytes of code per outer iteration, the normal version the same number.
+ */
+#define BYTES_PER_ITERATION	1048576
+
+/*
+ * Block of code placed on every page by itlb-sparse: 8 instructions of 7 bytes and a 5-byte jump.
+ */
+#define PAGE_SIZE_4K	4096
+#define BLOCK_BYTES	64
+#define BLOCK_INSNS	8
+
+/*
+ * Number of independent dependency chains.
+ */
+#define CHAINS		6
+
+/*
+ * Loop structure: rdi = outer counter, rcx = inner counter, rax/rdx/r8-r11 = accumulators.
+ */
+static const jit_reg_t chain_regs[CHAINS] = { JIT_RAX, JIT_RDX, JIT_R8, JIT_R9, JIT_R10, JIT_R11 };
+
+typedef enum {
+	LAYOUT_FLAT = 0, LAYOUT_SPARSE
+} layout_t;
+
+/*
+ * Straight-line code of the given size made of 7-byte adds, padded with a NOP.
+ */
+static void emit_flat(jit_buffer_t *jit, long code_bytes) {
+	size_t end = jit->len + code_bytes;
+	int chain = 0;
+	while (jit->len + 7 <= end) {
+		jit_alu_r64_imm32(jit, JIT_ALU_ADD, chain_regs[chain], 1);
+		chain = (chain + 1) % CHAINS;
+	}
+	jit_nop(jit, end - jit->len);
+}
+
+/*
+ * One block per page, the last block jumps to the end of the span.
+ */
+static void emit_sparse(jit_buffer_t *jit, long code_bytes) {
+	size_t start = (jit->len + PAGE_SIZE_4K - 1) & ~(size_t)(PAGE_SIZE_4K - 1);
+	long pages = code_bytes / PAGE_SIZE_4K > 0 ? code_bytes / PAGE_SIZE_4K : 1;
+	size_t end = start + pages * PAGE_SIZE_4K;
+	long page = 0;
+	int k = 0;
+
+	/* Jump to the first block */
+	jit_jmp(jit, start);
+	for (page = 0; page < pages; page++) {
+		size_t block = start + page * PAGE_SIZE_4K + (page * BLOCK_BYTES) % PAGE_SIZE_4K;
+		size_t next = page + 1 < pages ? start + (page + 1) * PAGE_SIZE_4K + ((page + 1) * BLOCK_BYTES) % PAGE_SIZE_4K : end;
+		jit_nop(jit, block - jit->len);
+		for (k = 0; k < BLOCK_INSNS; k++) {
+			jit_alu_r64_imm32(jit, JIT_ALU_ADD, chain_regs[k % CHAINS], 1);
+		}
+		jit_jmp(jit, next);
+	}
+	jit_nop(jit, end - jit->len);
+}
+
+/*
+ * Bytes of code executed per pass over a footprint of the given size.
+ */
+static long executed_bytes(layout_t layout, long code_bytes) {
+	return layout == LAYOUT_FLAT ? code_bytes : code_bytes / PAGE_SIZE_4K * BLOCK_BYTES;
+}
+
+/*
+ * Generate the kernel: for (i = 0; i < ntimes; i++) for (j = 0; j < inner_iters; j++) { code }
+ */
+static int generate_kernel(jit_buffer_t *jit, layout_t layout, long code_bytes, long inner_iters) {
+	int chain = 0;
+
+	if (!jit_alloc(jit, (code_bytes + 2 * PAGE_SIZE_4K + PAGE_SIZE_4K - 1) & ~(long)(PAGE_SIZE_4K - 1))) {
+		return 0;
+	}
+	for (chain = 0; chain < CHAINS; chain++) {
+		jit_xor_r32_r32(jit, chain_regs[chain], chain_regs[chain]);
+	}
+	size_t outer = jit_label(jit);
+	jit_mov_r64_imm64(jit, JIT_RCX, inner_iters);
+	size_t inner = jit_label(jit);
+	if (layout == LAYOUT_FLAT) {
+		emit_flat(jit, code_bytes);
+	} else {
+		emit_sparse(jit, code_bytes);
+	}
+	jit_dec_r64(jit, JIT_RCX);
+	jit_jnz(jit, inner);
+	jit_dec_r64(jit, JIT_RDI);
+	jit_jnz(jit, outer);
+	for (chain = 1; chain < CHAINS; chain++) {
+		jit_add_r64_r64(jit, JIT_RAX, chain_regs[chain]);
+	}
+	jit_ret(jit);
+	return jit_finalize(jit);
+}
+
+typedef struct {
+	layout_t layout;
+	jit_buffer_t normal;
+	jit_buffer_t extreme;
+} benchdata_t;
+
+/*
+ * Regenerate both kernels for the requested code size in bytes. The size is rounded up to a multiple
+ * of the normal footprint, so that the normal version can execute exactly as many bytes per outer
+ * iteration as the extreme version.
+ */
+static long bench_set_param(void *benchdata, long code_bytes) {
+	benchdata_t *data = benchdata;
+
+	if (code_bytes < 1) {
+		return -1;
+	}
+	code_bytes = (code_bytes + NORMAL_CODE_BYTES - 1) / NORMAL_CODE_BYTES * NORMAL_CODE_BYTES;
+	long extreme_bytes = executed_bytes(data->layout, code_bytes);
+	long extreme_iters = BYTES_PER_ITERATION / extreme_bytes > 0 ? BYTES_PER_ITERATION / extreme_bytes : 1;
+	long normal_iters = extreme_iters * extreme_bytes / executed_bytes(data->layout, NORMAL_CODE_BYTES);
+
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	if (!generate_kernel(&data->normal, data->layout, NORMAL_CODE_BYTES, normal_iters) ||
+	    !generate_kernel(&data->extreme, data->layout, code_bytes, extreme_iters)) {
+		return -1;
+	}
+	return code_bytes;
+}
+
+static int bench_init_layout(void **benchdata, layout_t layout) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	data->layout = layout;
+	return bench_set_param(data, DEFAULT_CODE_BYTES) > 0;
+}
+
+static int bench_init_flat(void **benchdata) {
+	return bench_init_layout(benchdata, LAYOUT_FLAT);
+}
+
+static int bench_init_sparse(void **benchdata) {
+	return bench_init_layout(benchdata, LAYOUT_SPARSE);
+}
+
+static int bench_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->normal.code)(ntimes, NULL);
+}
+
+static int bench_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->extreme.code)(ntimes, NULL);
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+#define ICACHE_COUNTERS { { NULL, NULL }, { NULL, NULL }, { "ICACHE:MISSES", "L1i misses:" }, { "ITLB_MISSES:WALK_COMPLETED", "iTLB walks:" } }
+
+static measure_benchmark_t bench_flat = {
+	.name = "icache-flat",
+	.init = bench_init_flat,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.counters = ICACHE_COUNTERS,
+	.ntimes = 20000,
+	.set_param = bench_set_param,
+	.param_name = "code_bytes",
+	.param_default = 0,
+};
+
+static measure_benchmark_t bench_sparse = {
+	.name = "itlb-sparse",
+	.init = bench_init_sparse,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.counters = ICACHE_COUNTERS,
+	.ntimes = 10000,
+	.set_param = bench_set_param,
+	.param_name = "code_bytes",
+	.param_default = 0,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench_flat)
+MEASURE_REGISTER_BENCHMARK(bench_sparse)
@@ -66,7 +66,7 @@ typedef unsigned long long kernel_data_t;
 /*
  * Benchmark kernels
  */
-kernel_data_t kernel_normal(long ntimes) {
+static kernel_data_t kernel_normal(long ntimes) {
 	long i = 0, j = 0;
 	kernel_data_t magic = 0, magic2 = 0, magic3 = 0;
 	for (i = 0; i < ntimes; i++) {
@@ -77,7 +77,7 @@ kernel_data_t kernel_normal(long ntimes) {
 	return magic + magic2 + magic3;
 }
 
-kernel_data_t kernel_extreme(long ntimes) {
+static kernel_data_t kernel_extreme(long ntimes) {
 	long i = 0, j = 0;
 	kernel_data_t magic = 0, magic2 = 0, magic3 = 0;
 	for (i = 0; i < ntimes; i++) {
@@ -118,16 +118,16 @@ static int bench_cleanup(void *benchdata) {
 	return 1;
 }
 
-int main(int argc, char **argv) {
-	measure_benchmark_t bench;
-	memset(&bench, 0, sizeof(bench));
-
-	/* Set up benchmark parameters */
-	bench.ntimes = NTIMES;
-	bench.init = bench_init;
-	bench.normal = bench_normal;
-	bench.extreme = bench_extreme;
-	bench.cleanup = bench_cleanup;
-
-	return measure_main(argc, argv, &bench);
-}
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench = {
+	.name = "int-algo-prng-multi3c",
+	.init = bench_init,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = NTIMES,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench)
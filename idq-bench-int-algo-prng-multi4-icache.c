@@ -68,7 +68,7 @@ typedef unsigned long long kernel_data_t;
 /*
  * Benchmark kernels
  */
-kernel_data_t kernel_normal(long ntimes) {
+static kernel_data_t kernel_normal(long ntimes) {
 	long i = 0, j = 0;
 	kernel_data_t magic = 0, magic2 = 0, magic3 = 0, magic4 = 0;
 	for (i = 0; i < ntimes; i++) {
@@ -79,7 +79,7 @@ kernel_data_t kernel_normal(long ntimes) {
 	return magic + magic2 + magic3 + magic4;
 }
 
-kernel_data_t kernel_extreme(long ntimes) {
+static kernel_data_t kernel_extreme(long ntimes) {
 	long i = 0, j = 0;
 	kernel_data_t magic = 0, magic2 = 0, magic3 = 0, magic4 = 0;
 	for (i = 0; i < ntimes; i++) {
@@ -120,16 +120,16 @@ static int bench_cleanup(void *benchdata) {
 	return 1;
 }
 
-int main(int argc, char **argv) {
-	measure_benchmark_t bench;
-	memset(&bench, 0, sizeof(bench));
-
-	/* Set up benchmark parameters */
-	bench.ntimes = NTIMES;
-	bench.init = bench_init;
-	bench.normal = bench_normal;
-	bench.extreme = bench_extreme;
-	bench.cleanup = bench_cleanup;
-
-	return measure_main(argc, argv, &bench);
-}
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench = {
+	.name = "int-algo-prng-multi4-icache",
+	.init = bench_init,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = NTIMES,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench)
@@ -0,0 +1,326 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * Bytecode interpreter dispatch. A small register machine with 16 opcodes runs a synthetic program
+ * whose length is swept with -s and whose opcodes are drawn uniformly from 16, 4 or 2 of the opcodes,
+ * i.e. with 4, 2 or 1 bits of entropy per opcode.
+ *
+ * Variants:
+ *   interp-switch[-2bit|-1bit]  switch statement, compiled to a jump table with a single indirect jump
+ *   interp-goto[-2bit|-1bit]    computed goto (labels as values), with an indirect jump at the end of
+ *                               every handler so that each handler has its own branch history
+ *
+ * Both versions execute the same uops. Every handler ends with a taken jump over padding bytes, which
+ * are absent in the normal version and 1984 bytes in the extreme version, so that the handlers of the
+ * extreme version span 32 kB of code instead of a few cache lines.
+ *
+ * The fourth counter collects BR_MISP_EXEC:TAKEN_INDIRECT_JUMP_NON_CALL_RET instead of the MS uops,
+ * so the idq_ms columns hold the indirect jump mispredicts. The CSV rows end with the energy, uops and
+ * indirect jump mispredicts per dispatched opcode.
+ *
+ * Usage: ./idq-bench-interp --run <variant> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -s <program length from>:<to>[:<factor>] ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+
+/*
+ * Number of opcodes, and the opcode which ends a pass over the program.
+ */
+#define NUM_OPCODES	16
+#define OP_END		NUM_OPCODES
+
+/*
+ * Default program length in opcodes, which ntimes was tuned for.
+ */
+#define DEFAULT_PROGRAM_LENGTH	4096
+
+/*
+ * Bytes of padding after every handler of the extreme version.
+ */
+#define NORMAL_PAD_BYTES	0
+#define EXTREME_PAD_BYTES	1984
+
+#define STRINGIFY(x)	#x
+#define PAD_STRING(x)	STRINGIFY(x)
+
+/*
+ * Taken jump over the padding, the same uop with or without padding.
+ */
+#define HANDLER_PAD(bytes) __asm__ __volatile__ ("jmp 1f\n\t.if " PAD_STRING(bytes) "\n\t.skip " PAD_STRING(bytes) ", 0xcc\n\t.endif\n1:")
+
+/*
+ * The opcodes of the register machine, applied to an accumulator and a register.
+ */
+#define INTERP_OPS(OP, pad) \
+	OP(0, acc += 1, pad) \
+	OP(1, acc ^= reg, pad) \
+	OP(2, acc *= 3, pad) \
+	OP(3, acc >>= 1, pad) \
+	OP(4, reg += acc, pad) \
+	OP(5, acc -= reg, pad) \
+	OP(6, acc = ~acc, pad) \
+	OP(7, acc = (acc << 7) | (acc >> 57), pad) \
+	OP(8, reg ^= acc >> 3, pad) \
+	OP(9, acc += 0x9e3779b9, pad) \
+	OP(10, acc &= reg | 1, pad) \
+	OP(11, acc |= 0x100, pad) \
+	OP(12, reg *= 5, pad) \
+	OP(13, acc = -acc, pad) \
+	OP(14, acc += reg >> 2, pad) \
+	OP(15, reg -= 1, pad)
+
+/*
+ * Switch dispatch. Every pass over the program ends with OP_END, and the unreachable default
+ * removes the bounds check of the jump table.
+ */
+#define SWITCH_CASE(n, code, pad) case n: code; HANDLER_PAD(pad); break;
+
+#define DEFINE_SWITCH_INTERP(name, pad) \
+static uint64_t name(const unsigned char *program, long ntimes) { \
+	uint64_t acc = 1, reg = 1; \
+	long pc = 0; \
+	for (;;) { \
+		switch (program[pc++]) { \
+		INTERP_OPS(SWITCH_CASE, pad) \
+		case OP_END: \
+			if (--ntimes <= 0) return acc + reg; \
+			pc = 0; \
+			break; \
+		default: \
+			__builtin_unreachable(); \
+		} \
+	} \
+}
+
+/*
+ * Computed goto dispatch, the dispatch is replicated at the end of every handler.
+ */
+#define GOTO_LABEL(n, code, pad) &&op_##n,
+#define GOTO_HANDLER(n, code, pad) op_##n: code; HANDLER_PAD(pad); goto *labels[program[pc++]];
+
+#define DEFINE_GOTO_INTERP(name, pad) \
+static uint64_t name(const unsigned char *program, long ntimes) { \
+	static const void *const labels[] = { INTERP_OPS(GOTO_LABEL, pad) &&op_end }; \
+	uint64_t acc = 1, reg = 1; \
+	long pc = 0; \
+	goto *labels[program[pc++]]; \
+	INTERP_OPS(GOTO_HANDLER, pad) \
+op_end: \
+	if (--ntimes <= 0) return acc + reg; \
+	pc = 0; \
+	goto *labels[program[pc++]]; \
+}
+
+DEFINE_SWITCH_INTERP(interp_switch_normal, NORMAL_PAD_BYTES)
+DEFINE_GOTO_INTERP(interp_goto_normal, NORMAL_PAD_BYTES)
+DEFINE_SWITCH_INTERP(interp_switch_extreme, EXTREME_PAD_BYTES)
+DEFINE_GOTO_INTERP(interp_goto_extreme, EXTREME_PAD_BYTES)
+
+typedef struct {
+	int entropy_bits;
+	unsigned char *program;
+} benchdata_t;
+
+/*
+ * Regenerate the program with the requested number of opcodes. The opcodes of the lower entropies
+ * are spread evenly over the handlers.
+ */
+static long bench_set_param(void *benchdata, long length) {
+	benchdata_t *data = benchdata;
+	long i = 0;
+
+	if (length < 1) {
+		return -1;
+	}
+	free(data->program);
+	data->program = measure_aligned_alloc(length + 1, 64);
+	for (i = 0; i < length; i++) {
+		uint64_t value = measure_rand64() >> 32;
+		data->program[i] = (value & ((1 << data->entropy_bits) - 1)) << (4 - data->entropy_bits);
+	}
+	data->program[length] = OP_END;
+	return length;
+}
+
+static int bench_init_entropy(void **benchdata, int entropy_bits) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	data->entropy_bits = entropy_bits;
+	return bench_set_param(data, DEFAULT_PROGRAM_LENGTH) > 0;
+}
+
+static int bench_init_4bit(void **benchdata) {
+	return bench_init_entropy(benchdata, 4);
+}
+
+static int bench_init_2bit(void **benchdata) {
+	return bench_init_entropy(benchdata, 2);
+}
+
+static int bench_init_1bit(void **benchdata) {
+	return bench_init_entropy(benchdata, 1);
+}
+
+static int kernel_switch_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return interp_switch_normal(data->program, ntimes) != 0;
+}
+
+static int kernel_switch_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return interp_switch_extreme(data->program, ntimes) != 0;
+}
+
+static int kernel_goto_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return interp_goto_normal(data->program, ntimes) != 0;
+}
+
+static int kernel_goto_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return interp_goto_extreme(data->program, ntimes) != 0;
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	free(data->program);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+#define INTERP_COUNTERS { { NULL, NULL }, { NULL, NULL }, { NULL, NULL }, { "BR_MISP_EXEC:TAKEN_INDIRECT_JUMP_NON_CALL_RET", "Indirect mispredicts:" } }
+
+static measure_benchmark_t bench_switch = {
+	.name = "interp-switch",
+	.init = bench_init_4bit,
+	.normal = kernel_switch_normal,
+	.extreme = kernel_switch_extreme,
+	.cleanup = bench_cleanup,
+	.counters = INTERP_COUNTERS,
+	.ntimes = 10000,
+	.set_param = bench_set_param,
+	.param_name = "program_length",
+	.param_default = DEFAULT_PROGRAM_LENGTH,
+	.ops_per_iteration = DEFAULT_PROGRAM_LENGTH,
+	.per_op_counter = 4,
+};
+
+static measure_benchmark_t bench_switch_2bit = {
+	.name = "interp-switch-2bit",
+	.init = bench_init_2bit,
+	.normal = kernel_switch_normal,
+	.extreme = kernel_switch_extreme,
+	.cleanup = bench_cleanup,
+	.counters = INTERP_COUNTERS,
+	.ntimes = 10000,
+	.set_param = bench_set_param,
+	.param_name = "program_length",
+	.param_default = DEFAULT_PROGRAM_LENGTH,
+	.ops_per_iteration = DEFAULT_PROGRAM_LENGTH,
+	.per_op_counter = 4,
+};
+
+static measure_benchmark_t bench_switch_1bit = {
+	.name = "interp-switch-1bit",
+	.init = bench_init_1bit,
+	.normal = kernel_switch_normal,
+	.extreme = kernel_switch_extreme,
+	.cleanup = bench_cleanup,
+	.counters = INTERP_COUNTERS,
+	.ntimes = 10000,
+	.set_param = bench_set_param,
+	.param_name = "program_length",
+	.param_default = DEFAULT_PROGRAM_LENGTH,
+	.ops_per_iteration = DEFAULT_PROGRAM_LENGTH,
+	.per_op_counter = 4,
+};
+
+static measure_benchmark_t bench_goto = {
+	.name = "interp-goto",
+	.init = bench_init_4bit,
+	.normal = kernel_goto_normal,
+	.extreme = kernel_goto_extreme,
+	.cleanup = bench_cleanup,
+	.counters = INTERP_COUNTERS,
+	.ntimes = 10000,
+	.set_param = bench_set_param,
+	.param_name = "program_length",
+	.param_default = DEFAULT_PROGRAM_LENGTH,
+	.ops_per_iteration = DEFAULT_PROGRAM_LENGTH,
+	.per_op_counter = 4,
+};
+
+static measure_benchmark_t bench_goto_2bit = {
+	.name = "interp-goto-2bit",
+	.init = bench_init_2bit,
+	.normal = kernel_goto_normal,
+	.extreme = kernel_goto_extreme,
+	.cleanup = bench_cleanup,
+	.counters = INTERP_COUNTERS,
+	.ntimes = 10000,
+	.set_param = bench_set_param,
+	.param_name = "program_length",
+	.param_default = DEFAULT_PROGRAM_LENGTH,
+	.ops_per_iteration = DEFAULT_PROGRAM_LENGTH,
+	.per_op_counter = 4,
+};
+
+static measure_benchmark_t bench_goto_1bit = {
+	.name = "interp-goto-1bit",
+	.init = bench_init_1bit,
+	.normal = kernel_goto_normal,
+	.extreme = kernel_goto_extreme,
+	.cleanup = bench_cleanup,
+	.counters = INTERP_COUNTERS,
+	.ntimes = 10000,
+	.set_param = bench_set_param,
+	.param_name = "program_length",
+	.param_default = DEFAULT_PROGRAM_LENGTH,
+	.ops_per_iteration = DEFAULT_PROGRAM_LENGTH,
+	.per_op_counter = 4,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench_switch)
+MEASURE_REGISTER_BENCHMARK(bench_switch_2bit)
+MEASURE_REGISTER_BENCHMARK(bench_switch_1bit)
+MEASURE_REGISTER_BENCHMARK(bench_goto)
+MEASURE_REGISTER_BENCHMARK(bench_goto_2bit)
+MEASURE_REGISTER_BENCHMARK(bench_goto_1bit)
@@ -0,0 +1,329 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * The loop body is generated at runtime with any unroll count, so the code footprint can be swept
+ * continuously across the DSB and L1 instruction cache capacities with -s <from>:<to> (in bytes).
+ * The extreme version is the same loop with twice the unroll count and half the inner iterations,
+ * so both versions execute the same number of loop bodies.
+ *
+ * Usage: ./idq-bench-jit --run <name> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -s <code bytes from>:<to>[:<factor>] ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+#include "x86-jit.h"
+
+/*
+ * Number of inner loop iterations, and elements in the data array.
+ * 1 array * 2048 elements/array * 8 bytes/element = 16 kB
+ */
+#define ARRAY_SIZE	2048
+
+/*
+ * Align arrays to a 2 MB boundary.
+ */
+#define ARRAY_ALIGNMENT	2097152
+
+/*
+ * Default size of the normal loop body in bytes.
+ */
+#define DEFAULT_CODE_BYTES	2048
+
+/*
+ * Extra room in the code buffer for the loop structure around the body.
+ */
+#define CODE_OVERHEAD	256
+
+/*
+ * Loop body templates. Registers: rdi = outer counter, rsi = data array, rcx = inner counter,
+ * rax/rdx/r8/r9 = accumulators, r10/r11 = 64-bit constants. Only caller-saved registers are used.
+ */
+typedef struct {
+	void (*prologue)(jit_buffer_t *jit);
+	void (*body)(jit_buffer_t *jit, long k);
+	void (*epilogue)(jit_buffer_t *jit);
+	char uses_float;
+	char walks_array;
+} jit_template_t;
+
+static void prologue_int(jit_buffer_t *jit) {
+	jit_xor_r32_r32(jit, JIT_RAX, JIT_RAX);
+	jit_xor_r32_r32(jit, JIT_RDX, JIT_RDX);
+	jit_xor_r32_r32(jit, JIT_R8, JIT_R8);
+	jit_xor_r32_r32(jit, JIT_R9, JIT_R9);
+	jit_mov_r64_imm64(jit, JIT_R10, 6364136223846793005ULL);
+	jit_mov_r64_imm64(jit, JIT_R11, 1442695040888963407ULL);
+}
+
+static void epilogue_int(jit_buffer_t *jit) {
+	jit_add_r64_r64(jit, JIT_RAX, JIT_RDX);
+	jit_add_r64_r64(jit, JIT_RAX, JIT_R8);
+	jit_add_r64_r64(jit, JIT_RAX, JIT_R9);
+}
+
+static void prologue_float(jit_buffer_t *jit) {
+	jit_xorpd_xmm_xmm(jit, 0, 0);
+}
+
+static void epilogue_float(jit_buffer_t *jit) {
+	jit_cvttsd2si_r64_xmm(jit, JIT_RAX, 0);
+}
+
+/* magic = (1103515245 * magic + 12345); */
+static void body_prng(jit_buffer_t *jit, long k) {
+	(void)k;
+	jit_imul_r64_r64_imm32(jit, JIT_RAX, JIT_RAX, 1103515245);
+	jit_add_r64_imm32(jit, JIT_RAX, 12345);
+}
+
+/* Four independent LCGs like idq-bench-int-algo-prng-multi4 */
+static void body_prng_multi4(jit_buffer_t *jit, long k) {
+	(void)k;
+	jit_imul_r64_r64_imm32(jit, JIT_RAX, JIT_RAX, 1103515245);
+	jit_add_r64_imm32(jit, JIT_RAX, 12345);
+	jit_imul_r64_r64_imm32(jit, JIT_RDX, JIT_RDX, 1664525);
+	jit_add_r64_imm32(jit, JIT_RDX, 1013904223);
+	jit_imul_r64_r64_imm32(jit, JIT_R8, JIT_R8, 22695477);
+	jit_add_r64_imm32(jit, JIT_R8, 1);
+	jit_imul_r64_r64(jit, JIT_R9, JIT_R10);
+	jit_add_r64_r64(jit, JIT_R9, JIT_R11);
+}
+
+/* sum += a[j + k]; rsi advances by the unroll count every inner iteration */
+static void body_int_add(jit_buffer_t *jit, long k) {
+	jit_add_r64_mem(jit, JIT_RAX, JIT_RSI, (k % ARRAY_SIZE) * 8);
+}
+
+/* sum += a[j + k]; in double precision */
+static void body_float_add(jit_buffer_t *jit, long k) {
+	jit_addsd_xmm_mem(jit, 0, JIT_RSI, (k % ARRAY_SIZE) * 8);
+}
+
+static const jit_template_t template_prng = { prologue_int, body_prng, epilogue_int, 0, 0 };
+static const jit_template_t template_prng_multi4 = { prologue_int, body_prng_multi4, epilogue_int, 0, 0 };
+static const jit_template_t template_int_add = { prologue_int, body_int_add, epilogue_int, 0, 1 };
+static const jit_template_t template_float_add = { prologue_float, body_float_add, epilogue_float, 1, 1 };
+
+/*
+ * Size of one loop body instance in bytes. Every instance has the same length.
+ */
+static size_t template_body_bytes(const jit_template_t *tmpl) {
+	jit_buffer_t scratch;
+	size_t len = 0;
+	if (!jit_alloc(&scratch, 4096)) {
+		return 0;
+	}
+	tmpl->body(&scratch, 0);
+	len = scratch.len;
+	jit_free(&scratch);
+	return len;
+}
+
+/*
+ * Generate the kernel: for (i = 0; i < ntimes; i++) for (j = 0; j < inner_iters * unroll; j += unroll) body x unroll
+ * The array pointer advances by the unroll count every inner iteration as long as the whole pass
+ * fits in the array. Longer bodies wrap their displacements around the array instead.
+ */
+static int generate_kernel(jit_buffer_t *jit, const jit_template_t *tmpl, long unroll, long inner_iters, size_t body_bytes) {
+	size_t size = (unroll * body_bytes + CODE_OVERHEAD + 4095) & ~(size_t)4095;
+	int32_t stride = tmpl->walks_array && unroll * inner_iters <= ARRAY_SIZE ? unroll * 8 : 0;
+	long k = 0;
+
+	if (!jit_alloc(jit, size)) {
+		return 0;
+	}
+	tmpl->prologue(jit);
+	size_t outer = jit_label(jit);
+	jit_mov_r64_imm64(jit, JIT_RCX, inner_iters);
+	size_t inner = jit_label(jit);
+	for (k = 0; k < unroll; k++) {
+		tmpl->body(jit, k);
+	}
+	if (stride) {
+		jit_add_r64_imm32(jit, JIT_RSI, stride);
+	}
+	jit_dec_r64(jit, JIT_RCX);
+	jit_jnz(jit, inner);
+	if (stride) {
+		/* Rewind to the start of the array */
+		jit_add_r64_imm32(jit, JIT_RSI, -stride * inner_iters);
+	}
+	jit_dec_r64(jit, JIT_RDI);
+	jit_jnz(jit, outer);
+	tmpl->epilogue(jit);
+	jit_ret(jit);
+	return jit_finalize(jit);
+}
+
+typedef struct {
+	const jit_template_t *tmpl;
+	size_t body_bytes;
+	uint64_t *a;
+	jit_buffer_t normal;
+	jit_buffer_t extreme;
+} benchdata_t;
+
+/*
+ * Regenerate both kernels for the requested normal loop body size in bytes.
+ */
+static long bench_set_param(void *benchdata, long code_bytes) {
+	benchdata_t *data = benchdata;
+	long unroll = code_bytes / (long)data->body_bytes > 0 ? code_bytes / (long)data->body_bytes : 1;
+	/* The extreme version runs half as many inner iterations, so both do the same work */
+	long pairs = ARRAY_SIZE / (2 * unroll) > 0 ? ARRAY_SIZE / (2 * unroll) : 1;
+
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	if (!generate_kernel(&data->normal, data->tmpl, unroll, 2 * pairs, data->body_bytes) ||
+	    !generate_kernel(&data->extreme, data->tmpl, 2 * unroll, pairs, data->body_bytes)) {
+		return -1;
+	}
+
+	/* Effective body size of the normal version */
+	return unroll * data->body_bytes;
+}
+
+static int bench_init_template(void **benchdata, const jit_template_t *tmpl) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	data->tmpl = tmpl;
+	data->body_bytes = template_body_bytes(tmpl);
+	if (data->body_bytes == 0) {
+		return 0;
+	}
+
+	/* Allocate memory for the data array */
+	data->a = measure_aligned_alloc(ARRAY_SIZE * sizeof(*data->a), ARRAY_ALIGNMENT);
+
+	/* Fill with the data pattern selected with -d */
+	if (tmpl->uses_float) {
+		measure_fill_float_array(data->a, ARRAY_SIZE, sizeof(double));
+	} else {
+		measure_fill_int_array(data->a, ARRAY_SIZE, sizeof(*data->a));
+	}
+
+	return bench_set_param(data, DEFAULT_CODE_BYTES) > 0;
+}
+
+static int bench_init_prng(void **benchdata) {
+	return bench_init_template(benchdata, &template_prng);
+}
+
+static int bench_init_prng_multi4(void **benchdata) {
+	return bench_init_template(benchdata, &template_prng_multi4);
+}
+
+static int bench_init_int_add(void **benchdata) {
+	return bench_init_template(benchdata, &template_int_add);
+}
+
+static int bench_init_float_add(void **benchdata) {
+	return bench_init_template(benchdata, &template_float_add);
+}
+
+static int bench_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->normal.code)(ntimes, data->a);
+}
+
+static int bench_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->extreme.code)(ntimes, data->a);
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	free(data->a);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration. The iteration counts match the corresponding C benchmarks.
+ */
+static measure_benchmark_t bench_prng = {
+	.name = "jit-int-algo-prng",
+	.init = bench_init_prng,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 454000,
+	.set_param = bench_set_param,
+	.param_name = "code_bytes",
+	.param_default = DEFAULT_CODE_BYTES,
+};
+
+static measure_benchmark_t bench_prng_multi4 = {
+	.name = "jit-int-algo-prng-multi4",
+	.init = bench_init_prng_multi4,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 454000,
+	.set_param = bench_set_param,
+	.param_name = "code_bytes",
+	.param_default = DEFAULT_CODE_BYTES,
+};
+
+static measure_benchmark_t bench_int_add = {
+	.name = "jit-int-array-l1-add",
+	.init = bench_init_int_add,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 606000,
+	.set_param = bench_set_param,
+	.param_name = "code_bytes",
+	.param_default = DEFAULT_CODE_BYTES,
+};
+
+static measure_benchmark_t bench_float_add = {
+	.name = "jit-float-array-l1-add",
+	.init = bench_init_float_add,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 606000,
+	.set_param = bench_set_param,
+	.param_name = "code_bytes",
+	.param_default = DEFAULT_CODE_BYTES,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench_prng)
+MEASURE_REGISTER_BENCHMARK(bench_prng_multi4)
+MEASURE_REGISTER_BENCHMARK(bench_int_add)
+MEASURE_REGISTER_BENCHMARK(bench_float_add)
@@ -0,0 +1,465 @@
+/*
+ * Benchmark designed to measure the cost of AVX frequency license transitions. Designed for Intel
+ * processors with AVX-512.
+ *
+ * The extreme version cycles through scalar, AVX2 heavy and AVX-512 heavy sections, each lasting the
+ * given period in microseconds. Heavy sections run independent FMA chains, which move the core to a
+ * lower frequency license after a voltage ramp during which the wide instructions are throttled. The
+ * normal version runs the same number of sections with scalar code only. The period can be swept
+ * with -s, e.g. "-s 10:100000:10".
+ *
+ * Every section is split into chunks of constant work timed with RDTSC. The steady chunk time of a
+ * section is the median chunk time at the end of the section, and the transition lasts until the
+ * first chunk within 25% of it. The time lost in the slower chunks before that is the wasted time. APERF, MPERF
+ * and the package energy counter are read from the MSRs at the section boundaries when /dev/cpu/N/msr
+ * is readable, giving the effective frequency and power of each section type. After every measured run
+ * of the extreme version one comment line per section type is printed for all threads together:
+ *
+ *   # section=avx512,period_us=1000,sections=333,freq_mhz=2800,power_w=85.2,transition_us=12.5,wasted_us=9.1,wasted_uj=775.3
+ *
+ * where sections is summed over the threads and transition_us, wasted_us and wasted_uj are averages
+ * per section. The package power is averaged over the threads reading the MSRs, as they all see the
+ * same package. Run with -a to keep the threads on the cores whose MSRs are read.
+ *
+ * Usage: ./idq-bench-license [ -a ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -s <period from>:<to>[:<factor>] ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Needed for sched_getcpu */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "measure-util.h"
+
+/* APERF and MPERF count actual and reference cycles in C0 */
+#define MSR_IA32_MPERF		0x00e7
+#define MSR_IA32_APERF		0x00e8
+
+/* Energy status unit and the package energy counter */
+#define MSR_RAPL_POWER_UNIT	0x0606
+#define MSR_PKG_ENERGY_STATUS	0x0611
+
+/*
+ * Default section period in microseconds.
+ */
+#define DEFAULT_PERIOD_US	1000
+
+/*
+ * Loop iterations per chunk. One iteration is 8 independent multiply-adds, so a chunk takes
+ * roughly a microsecond and the rdtsc overhead stays small.
+ */
+#define CHUNK_ITERATIONS	256
+
+/*
+ * Chunk times recorded per section. Chunks beyond this are run but not recorded, the transition
+ * is at the start of the section anyway.
+ */
+#define MAX_CHUNKS	65536
+
+/*
+ * Chunks at the end of the section used for the median.
+ */
+#define STEADY_CHUNKS	1024
+
+/*
+ * A chunk within this factor of the steady chunk time ends the transition.
+ */
+#define STEADY_TOLERANCE	1.25
+
+typedef enum {
+	SECTION_SCALAR = 0, SECTION_AVX2, SECTION_AVX512, NUM_SECTIONS
+} section_t;
+
+static const char *section_names[NUM_SECTIONS] = { "scalar", "avx2", "avx512" };
+
+/*
+ * Totals per section type since the start of the current run.
+ */
+typedef struct {
+	long sections;
+	uint64_t ticks;
+	uint64_t aperf;
+	uint64_t mperf;
+	double energy;
+	uint64_t transition_ticks;
+	uint64_t wasted_ticks;
+} section_stats_t;
+
+typedef struct {
+	long period_us;
+	uint64_t period_ticks;
+	int have_avx512;
+	int msr_fd;
+	double energy_unit;
+	uint64_t *chunk_ticks;
+	uint64_t *sorted_ticks;
+	section_stats_t stats[NUM_SECTIONS];
+} benchdata_t;
+
+/*
+ * TSC ticks per microsecond, calibrated once at startup.
+ */
+static double tsc_per_us = 0;
+static pthread_once_t tsc_once = PTHREAD_ONCE_INIT;
+
+static void calibrate_tsc(void) {
+	struct timespec begin, end;
+	uint64_t tsc_begin = 0, tsc_end = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	RDTSC(tsc_begin);
+	millisleep(100);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	RDTSC(tsc_end);
+	tsc_per_us = (tsc_end - tsc_begin) / ((end.tv_sec - begin.tv_sec) * 1e6 + (end.tv_nsec - begin.tv_nsec) / 1e3);
+}
+
+/*
+ * Chunks of constant work. The scalar chunk uses scalar SSE2 multiplies and adds, which run at the base
+ * license, and the heavy chunks use FMA on 256-bit and 512-bit registers. Every chunk clears its
+ * accumulators and adds small products, so the values never overflow or become denormal.
+ */
+static const double chunk_operand = 1e-9;
+
+static void chunk_scalar(void) {
+	long n = CHUNK_ITERATIONS;
+	__asm__ __volatile__(
+		"movsd %[x], %%xmm8\n\t"
+		"xorpd %%xmm0, %%xmm0\n\t"
+		"xorpd %%xmm1, %%xmm1\n\t"
+		"xorpd %%xmm2, %%xmm2\n\t"
+		"xorpd %%xmm3, %%xmm3\n\t"
+		"xorpd %%xmm4, %%xmm4\n\t"
+		"xorpd %%xmm5, %%xmm5\n\t"
+		"xorpd %%xmm6, %%xmm6\n\t"
+		"xorpd %%xmm7, %%xmm7\n\t"
+		"1:\n\t"
+		"mulsd %%xmm8, %%xmm0\n\t"
+		"mulsd %%xmm8, %%xmm1\n\t"
+		"mulsd %%xmm8, %%xmm2\n\t"
+		"mulsd %%xmm8, %%xmm3\n\t"
+		"addsd %%xmm8, %%xmm4\n\t"
+		"addsd %%xmm8, %%xmm5\n\t"
+		"addsd %%xmm8, %%xmm6\n\t"
+		"addsd %%xmm8, %%xmm7\n\t"
+		"dec %[n]\n\t"
+		"jnz 1b"
+		: [n] "+r" (n)
+		: [x] "m" (chunk_operand)
+		: "cc", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8");
+}
+
+__attribute__((target("avx2,fma")))
+static void chunk_avx2(void) {
+	long n = CHUNK_ITERATIONS;
+	__asm__ __volatile__(
+		"vbroadcastsd %[x], %%ymm8\n\t"
+		"vxorpd %%ymm0, %%ymm0, %%ymm0\n\t"
+		"vxorpd %%ymm1, %%ymm1, %%ymm1\n\t"
+		"vxorpd %%ymm2, %%ymm2, %%ymm2\n\t"
+		"vxorpd %%ymm3, %%ymm3, %%ymm3\n\t"
+		"vxorpd %%ymm4, %%ymm4, %%ymm4\n\t"
+		"vxorpd %%ymm5, %%ymm5, %%ymm5\n\t"
+		"vxorpd %%ymm6, %%ymm6, %%ymm6\n\t"
+		"vxorpd %%ymm7, %%ymm7, %%ymm7\n\t"
+		"1:\n\t"
+		"vfmadd231pd %%ymm8, %%ymm8, %%ymm0\n\t"
+		"vfmadd231pd %%ymm8, %%ymm8, %%ymm1\n\t"
+		"vfmadd231pd %%ymm8, %%ymm8, %%ymm2\n\t"
+		"vfmadd231pd %%ymm8, %%ymm8, %%ymm3\n\t"
+		"vfmadd231pd %%ymm8, %%ymm8, %%ymm4\n\t"
+		"vfmadd231pd %%ymm8, %%ymm8, %%ymm5\n\t"
+		"vfmadd231pd %%ymm8, %%ymm8, %%ymm6\n\t"
+		"vfmadd231pd %%ymm8, %%ymm8, %%ymm7\n\t"
+		"dec %[n]\n\t"
+		"jnz 1b\n\t"
+		"vzeroupper"
+		: [n] "+r" (n)
+		: [x] "m" (chunk_operand)
+		: "cc", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8");
+}
+
+__attribute__((target("avx512f")))
+static void chunk_avx512(void) {
+	long n = CHUNK_ITERATIONS;
+	__asm__ __volatile__(
+		"vbroadcastsd %[x], %%zmm8\n\t"
+		"vpxorq %%zmm0, %%zmm0, %%zmm0\n\t"
+		"vpxorq %%zmm1, %%zmm1, %%zmm1\n\t"
+		"vpxorq %%zmm2, %%zmm2, %%zmm2\n\t"
+		"vpxorq %%zmm3, %%zmm3, %%zmm3\n\t"
+		"vpxorq %%zmm4, %%zmm4, %%zmm4\n\t"
+		"vpxorq %%zmm5, %%zmm5, %%zmm5\n\t"
+		"vpxorq %%zmm6, %%zmm6, %%zmm6\n\t"
+		"vpxorq %%zmm7, %%zmm7, %%zmm7\n\t"
+		"1:\n\t"
+		"vfmadd231pd %%zmm8, %%zmm8, %%zmm0\n\t"
+		"vfmadd231pd %%zmm8, %%zmm8, %%zmm1\n\t"
+		"vfmadd231pd %%zmm8, %%zmm8, %%zmm2\n\t"
+		"vfmadd231pd %%zmm8, %%zmm8, %%zmm3\n\t"
+		"vfmadd231pd %%zmm8, %%zmm8, %%zmm4\n\t"
+		"vfmadd231pd %%zmm8, %%zmm8, %%zmm5\n\t"
+		"vfmadd231pd %%zmm8, %%zmm8, %%zmm6\n\t"
+		"vfmadd231pd %%zmm8, %%zmm8, %%zmm7\n\t"
+		"dec %[n]\n\t"
+		"jnz 1b\n\t"
+		"vzeroupper"
+		: [n] "+r" (n)
+		: [x] "m" (chunk_operand)
+		: "cc", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8");
+}
+
+static int compare_ticks(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Read APERF, MPERF and the package energy counter. Reading is disabled after the first failure.
+ */
+static void read_counters(benchdata_t *data, uint64_t *aperf, uint64_t *mperf, uint64_t *energy) {
+	if (data->msr_fd < 0) {
+		return;
+	}
+	if (!measure_read_msr(data->msr_fd, MSR_IA32_APERF, aperf) ||
+	    !measure_read_msr(data->msr_fd, MSR_IA32_MPERF, mperf) ||
+	    !measure_read_msr(data->msr_fd, MSR_PKG_ENERGY_STATUS, energy)) {
+		close(data->msr_fd);
+		data->msr_fd = -1;
+	}
+}
+
+/*
+ * Run one section until its period has elapsed and add it to the statistics.
+ */
+static void run_section(benchdata_t *data, section_t section) {
+	section_stats_t *stats = &data->stats[section];
+	uint64_t begin = 0, end = 0, now = 0, last = 0, steady = 0;
+	uint64_t aperf_begin = 0, mperf_begin = 0, energy_begin = 0, aperf_end = 0, mperf_end = 0, energy_end = 0;
+	long chunks = 0, tail = 0, k = 0;
+
+	read_counters(data, &aperf_begin, &mperf_begin, &energy_begin);
+	RDTSC(begin);
+	last = begin;
+	do {
+		if (section == SECTION_AVX512) {
+			chunk_avx512();
+		} else if (section == SECTION_AVX2) {
+			chunk_avx2();
+		} else {
+			chunk_scalar();
+		}
+		RDTSC(now);
+		if (chunks < MAX_CHUNKS) {
+			data->chunk_ticks[chunks] = now - last;
+		}
+		chunks++;
+		last = now;
+	} while (now - begin < data->period_ticks);
+	end = now;
+	read_counters(data, &aperf_end, &mperf_end, &energy_end);
+
+	/* Steady chunk time from the second half, then the chunks before it settled */
+	if (chunks > MAX_CHUNKS) {
+		chunks = MAX_CHUNKS;
+	}
+	tail = chunks / 2 < STEADY_CHUNKS ? chunks / 2 : STEADY_CHUNKS;
+	if (tail > 0) {
+		memcpy(data->sorted_ticks, data->chunk_ticks + chunks - tail, tail * sizeof(*data->sorted_ticks));
+		qsort(data->sorted_ticks, tail, sizeof(*data->sorted_ticks), compare_ticks);
+		steady = data->sorted_ticks[tail / 2];
+	}
+	for (k = 0; k < chunks / 2 && data->chunk_ticks[k] > STEADY_TOLERANCE * steady; k++) {
+		stats->transition_ticks += data->chunk_ticks[k];
+		stats->wasted_ticks += data->chunk_ticks[k] - steady;
+	}
+
+	stats->sections++;
+	stats->ticks += end - begin;
+	stats->aperf += aperf_end - aperf_begin;
+	stats->mperf += mperf_end - mperf_begin;
+	/* The energy counter is 32 bits wide and wraps around */
+	stats->energy += (uint32_t)(energy_end - energy_begin) * data->energy_unit;
+}
+
+/*
+ * Report hook, called from the main thread after every measured run of the extreme version. Prints
+ * one comment line per section type, averaged over the sections of all threads. Every thread reads
+ * the energy of the whole package, so the power comes from the energy and time of the threads
+ * reading the MSRs together rather than from the sum of their energies.
+ */
+static void report_stats(void **benchdata, int num_threads) {
+	benchdata_t *first = benchdata[0];
+	int section = 0, i = 0;
+	for (section = 0; section < NUM_SECTIONS; section++) {
+		section_stats_t total;
+		uint64_t msr_ticks = 0;
+		memset(&total, 0, sizeof(total));
+		for (i = 0; i < num_threads; i++) {
+			benchdata_t *data = benchdata[i];
+			section_stats_t *stats = &data->stats[section];
+			total.sections += stats->sections;
+			total.ticks += stats->ticks;
+			total.transition_ticks += stats->transition_ticks;
+			total.wasted_ticks += stats->wasted_ticks;
+			if (data->msr_fd >= 0) {
+				total.aperf += stats->aperf;
+				total.mperf += stats->mperf;
+				total.energy += stats->energy;
+				msr_ticks += stats->ticks;
+			}
+		}
+		double seconds = msr_ticks / tsc_per_us / 1e6;
+		double power = seconds > 0 ? total.energy / seconds : 0;
+		if (total.sections == 0) {
+			continue;
+		}
+		printf("# section=%s,period_us=%ld,sections=%ld,freq_mhz=%.0f,power_w=%.2f,transition_us=%.2f,wasted_us=%.2f,wasted_uj=%.2f\n",
+		       section_names[section], first->period_us, total.sections,
+		       total.mperf > 0 ? tsc_per_us * total.aperf / total.mperf : 0, power,
+		       total.transition_ticks / tsc_per_us / total.sections,
+		       total.wasted_ticks / tsc_per_us / total.sections,
+		       power * total.wasted_ticks / tsc_per_us / total.sections);
+	}
+	fflush(stdout);
+}
+
+static long bench_set_param(void *benchdata, long period_us) {
+	benchdata_t *data = benchdata;
+
+	if (period_us < 1) {
+		return -1;
+	}
+	data->period_us = period_us;
+	data->period_ticks = period_us * tsc_per_us;
+	return period_us;
+}
+
+static int bench_init(void **benchdata) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+	uint64_t power_unit = 0;
+
+	pthread_once(&tsc_once, calibrate_tsc);
+	if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) {
+		fprintf(stderr, "Error: The CPU does not support AVX2 and FMA.\n");
+		return 0;
+	}
+	data->have_avx512 = __builtin_cpu_supports("avx512f");
+	if (!data->have_avx512) {
+		fprintf(stderr, "Warning: The CPU does not support AVX-512, alternating scalar and AVX2 sections only.\n");
+	}
+	data->chunk_ticks = measure_alloc(MAX_CHUNKS * sizeof(*data->chunk_ticks));
+	data->sorted_ticks = measure_alloc(STEADY_CHUNKS * sizeof(*data->sorted_ticks));
+
+	/* The MSRs of the core this thread started on */
+	data->msr_fd = measure_open_msr(sched_getcpu());
+	if (data->msr_fd >= 0 && measure_read_msr(data->msr_fd, MSR_RAPL_POWER_UNIT, &power_unit)) {
+		data->energy_unit = 1.0 / (1 << ((power_unit >> 8) & 0x1f));
+	} else if (data->msr_fd >= 0) {
+		close(data->msr_fd);
+		data->msr_fd = -1;
+	}
+
+	return bench_set_param(data, DEFAULT_PERIOD_US) > 0;
+}
+
+/*
+ * Normal version: every section is scalar.
+ */
+static int bench_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0;
+	int section = 0;
+
+	for (i = 0; i < ntimes; i++) {
+		for (section = 0; section < NUM_SECTIONS; section++) {
+			if (section == SECTION_AVX512 && !data->have_avx512) {
+				continue;
+			}
+			run_section(data, SECTION_SCALAR);
+		}
+	}
+	memset(data->stats, 0, sizeof(data->stats));
+	return 0;
+}
+
+/*
+ * Extreme version: scalar, AVX2 and AVX-512 sections in turn. The statistics of the run are
+ * printed by report_stats.
+ */
+static int bench_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0;
+	int section = 0;
+
+	memset(data->stats, 0, sizeof(data->stats));
+	for (i = 0; i < ntimes; i++) {
+		for (section = 0; section < NUM_SECTIONS; section++) {
+			if (section == SECTION_AVX512 && !data->have_avx512) {
+				continue;
+			}
+			run_section(data, section);
+		}
+	}
+	return 0;
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	if (data->msr_fd >= 0) {
+		close(data->msr_fd);
+	}
+	free(data->chunk_ticks);
+	free(data->sorted_ticks);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench = {
+	.name = "license-transition",
+	.init = bench_init,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 333,
+	.set_param = bench_set_param,
+	.param_name = "period_us",
+	.param_default = DEFAULT_PERIOD_US,
+	.report = report_stats,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench)
@@ -0,0 +1,568 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * Long-latency execution units: the integer and floating point dividers, the square root unit and the
+ * transcendental functions of libm and libmvec. The normal version of every benchmark runs a single
+ * dependent chain, so the unit is busy while the front-end mostly idles, and the extreme version runs
+ * the same number of operations on independent array elements, so the unit runs at full throughput.
+ *
+ *   longlat-div          64-bit div, the dividends have the top bit set so that every quotient has 62 bits
+ *   longlat-idiv         64-bit idiv with negative dividends of the same magnitude
+ *   longlat-divsd        scalar double precision division
+ *   longlat-sqrtpd       packed double precision square root, 128 bits
+ *   longlat-exp          exp() from libm
+ *   longlat-log          log() from libm
+ *   longlat-sin          sin() from libm
+ *   longlat-exp-vector   exp() from libmvec at the vector width selected with -V
+ *   longlat-log-vector   log() from libmvec at the vector width selected with -V
+ *   longlat-sin-vector   sin() from libmvec at the vector width selected with -V
+ *
+ * The independent versions read their operands from an array filled with the pattern selected with -d,
+ * the transcendental functions from a fixed array of values between 0.5 and 1.5. Both versions execute
+ * one operation per array element and iteration, which is counted for the energy per operation columns.
+ *
+ * Usage: ./idq-bench-longlat --run <benchmark> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -V sse|avx2|avx512 ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <math.h>
+
+#include "measure-util.h"
+
+/*
+ * Number of elements in the data arrays.
+ * 2048 elements/array * 8 bytes/element = 16 kB
+ */
+#define ARRAY_SIZE	2048
+
+/*
+ * Align arrays to a 2 MB boundary.
+ */
+#define ARRAY_ALIGNMENT	2097152
+
+/*
+ * Divisor of the integer divisions, and the numerator and multiplier which keep the floating point
+ * dependent chains away from exact values: x = 1.7 / x alternates and x = 1.7 * sqrt(x) converges to 2.89.
+ */
+#define INT_DIVISOR	5ULL
+#define FP_CONSTANT	1.7
+
+typedef double vec128_t __attribute__((vector_size(16)));
+typedef double vec256_t __attribute__((vector_size(32)));
+typedef double vec512_t __attribute__((vector_size(64)));
+
+/*
+ * libmvec entry points, named after the x86-64 vector function ABI: b = SSE, d = AVX2, e = AVX-512.
+ */
+vec128_t _ZGVbN2v_exp(vec128_t x);
+vec256_t _ZGVdN4v_exp(vec256_t x);
+vec512_t _ZGVeN8v_exp(vec512_t x);
+vec128_t _ZGVbN2v_log(vec128_t x);
+vec256_t _ZGVdN4v_log(vec256_t x);
+vec512_t _ZGVeN8v_log(vec512_t x);
+vec128_t _ZGVbN2v_sin(vec128_t x);
+vec256_t _ZGVdN4v_sin(vec256_t x);
+vec512_t _ZGVeN8v_sin(vec512_t x);
+
+/*
+ * A transcendental function at every width. The dependent chain computes x = f(multiplier * x + addend),
+ * which converges to a fixed point inside the fast path of the function.
+ */
+typedef struct {
+	double (*scalar)(double);
+	vec128_t (*sse)(vec128_t);
+	vec256_t (*avx2)(vec256_t);
+	vec512_t (*avx512)(vec512_t);
+	double multiplier;
+	double addend;
+} function_t;
+
+static const function_t function_exp = { exp, _ZGVbN2v_exp, _ZGVdN4v_exp, _ZGVeN8v_exp, -1.0, 0.0 };
+static const function_t function_log = { log, _ZGVbN2v_log, _ZGVdN4v_log, _ZGVeN8v_log, 1.0, 2.0 };
+static const function_t function_sin = { sin, _ZGVbN2v_sin, _ZGVdN4v_sin, _ZGVeN8v_sin, 1.0, 1.0 };
+
+typedef struct {
+	const function_t *function;
+	uint64_t *table;
+	double *values;
+	double *inputs;
+} benchdata_t;
+
+/*
+ * Integer division. The unsigned chain keeps the top bit of the dividend set, and the signed chain
+ * keeps the dividend negative with bit 62 clear, i.e. in [-2^63, -2^62). The negative quotient always
+ * has bit 62 set, so clearing it restores a dividend of the same magnitude for every division.
+ */
+static int kernel_div_dependent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	uint64_t rax = data->table[0], rdx = 0;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 8) {
+			__asm__ (
+				".rept 8\n\t"
+				"xor %%edx, %%edx\n\t"
+				"div %[divisor]\n\t"
+				"or %[high], %%rax\n\t"
+				".endr"
+				: "+a" (rax), "=&d" (rdx)
+				: [divisor] "r" (INT_DIVISOR), [high] "r" (1ULL << 63)
+				: "cc");
+		}
+	}
+	return rax;
+}
+
+static int kernel_div_independent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	uint64_t sum = 0, rax = 0, rdx = 0;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 8) {
+			__asm__ (
+				".irp k,0,1,2,3,4,5,6,7\n\t"
+				"mov \\k*8(%[a]), %%rax\n\t"
+				"xor %%edx, %%edx\n\t"
+				"div %[divisor]\n\t"
+				"add %%rax, %[sum]\n\t"
+				".endr"
+				: [sum] "+r" (sum), "=&a" (rax), "=&d" (rdx)
+				: [a] "r" (&data->table[j]), [divisor] "r" (INT_DIVISOR)
+				: "cc", "memory");
+		}
+	}
+	return sum;
+}
+
+static int kernel_idiv_dependent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	uint64_t rax = data->table[0] & ~(1ULL << 62), rdx = 0;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 8) {
+			__asm__ (
+				".rept 8\n\t"
+				"cqo\n\t"
+				"idiv %[divisor]\n\t"
+				"and %[mask], %%rax\n\t"
+				".endr"
+				: "+a" (rax), "=&d" (rdx)
+				: [divisor] "r" (INT_DIVISOR), [mask] "r" (~(1ULL << 62))
+				: "cc");
+		}
+	}
+	return rax;
+}
+
+static int kernel_idiv_independent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	uint64_t sum = 0, rax = 0, rdx = 0;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 8) {
+			__asm__ (
+				".irp k,0,1,2,3,4,5,6,7\n\t"
+				"mov \\k*8(%[a]), %%rax\n\t"
+				"cqo\n\t"
+				"idiv %[divisor]\n\t"
+				"add %%rax, %[sum]\n\t"
+				".endr"
+				: [sum] "+r" (sum), "=&a" (rax), "=&d" (rdx)
+				: [a] "r" (&data->table[j]), [divisor] "r" (INT_DIVISOR)
+				: "cc", "memory");
+		}
+	}
+	return sum;
+}
+
+/*
+ * Floating point division and square root. The register moves are eliminated at rename.
+ */
+static int kernel_divsd_dependent(void *benchdata, long ntimes) {
+	vec128_t x = { 1.5, 1.5 }, tmp;
+	const vec128_t numerator = { FP_CONSTANT, FP_CONSTANT };
+	long i = 0, j = 0;
+	(void)benchdata;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 8) {
+			__asm__ (
+				".rept 8\n\t"
+				"movapd %[numerator], %[tmp]\n\t"
+				"divsd %[x], %[tmp]\n\t"
+				"movapd %[tmp], %[x]\n\t"
+				".endr"
+				: [x] "+x" (x), [tmp] "=&x" (tmp)
+				: [numerator] "x" (numerator));
+		}
+	}
+	return x[0] != 0.0;
+}
+
+static int kernel_divsd_independent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	const vec128_t numerator = { FP_CONSTANT, FP_CONSTANT };
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 8) {
+			__asm__ __volatile__ (
+				".irp k,0,1,2,3,4,5,6,7\n\t"
+				"movapd %[numerator], %%xmm\\k\n\t"
+				"divsd \\k*8(%[a]), %%xmm\\k\n\t"
+				".endr"
+				:
+				: [a] "r" (&data->values[j]), [numerator] "x" (numerator)
+				: "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7");
+		}
+	}
+	return 1;
+}
+
+static int kernel_sqrtpd_dependent(void *benchdata, long ntimes) {
+	vec128_t x = { 1.5, 1.5 };
+	const vec128_t multiplier = { FP_CONSTANT, FP_CONSTANT };
+	long i = 0, j = 0;
+	(void)benchdata;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 16) {
+			__asm__ (
+				".rept 8\n\t"
+				"sqrtpd %[x], %[x]\n\t"
+				"mulpd %[multiplier], %[x]\n\t"
+				".endr"
+				: [x] "+x" (x)
+				: [multiplier] "x" (multiplier));
+		}
+	}
+	return x[0] != 0.0;
+}
+
+static int kernel_sqrtpd_independent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 16) {
+			__asm__ __volatile__ (
+				".irp k,0,1,2,3,4,5,6,7\n\t"
+				"sqrtpd \\k*16(%[a]), %%xmm\\k\n\t"
+				".endr"
+				:
+				: [a] "r" (&data->values[j])
+				: "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7");
+		}
+	}
+	return 1;
+}
+
+/*
+ * Scalar transcendental functions from libm.
+ */
+static int kernel_scalar_dependent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	const function_t *f = data->function;
+	double x = 1.0;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j++) {
+			x = f->scalar(f->multiplier * x + f->addend);
+		}
+	}
+	return x != 0.0;
+}
+
+static int kernel_scalar_independent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	const function_t *f = data->function;
+	double sum = 0.0;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j++) {
+			sum += f->scalar(data->inputs[j]);
+		}
+	}
+	return sum != 0.0;
+}
+
+/*
+ * Vector transcendental functions from libmvec. Each width is compiled for its own target so that
+ * the vectors are passed in registers of the right size.
+ */
+static __attribute__((noinline)) double vector_dependent_sse(const function_t *f, long ntimes) {
+	vec128_t x = { 1.0, 1.0 };
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 2) {
+			x = f->sse(f->multiplier * x + f->addend);
+		}
+	}
+	return x[0];
+}
+
+static __attribute__((noinline, target("avx2"))) double vector_dependent_avx2(const function_t *f, long ntimes) {
+	vec256_t x = { 1.0, 1.0, 1.0, 1.0 };
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 4) {
+			x = f->avx2(f->multiplier * x + f->addend);
+		}
+	}
+	return x[0];
+}
+
+static __attribute__((noinline, target("avx512f"))) double vector_dependent_avx512(const function_t *f, long ntimes) {
+	vec512_t x = { 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0 };
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 8) {
+			x = f->avx512(f->multiplier * x + f->addend);
+		}
+	}
+	return x[0];
+}
+
+static __attribute__((noinline)) double vector_independent_sse(const function_t *f, const double *inputs, long ntimes) {
+	vec128_t sum = { 0.0, 0.0 }, x;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 2) {
+			memcpy(&x, &inputs[j], sizeof(x));
+			sum += f->sse(x);
+		}
+	}
+	return sum[0];
+}
+
+static __attribute__((noinline, target("avx2"))) double vector_independent_avx2(const function_t *f, const double *inputs, long ntimes) {
+	vec256_t sum = { 0.0, 0.0, 0.0, 0.0 }, x;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 4) {
+			memcpy(&x, &inputs[j], sizeof(x));
+			sum += f->avx2(x);
+		}
+	}
+	return sum[0];
+}
+
+static __attribute__((noinline, target("avx512f"))) double vector_independent_avx512(const function_t *f, const double *inputs, long ntimes) {
+	vec512_t sum = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, x;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 8) {
+			memcpy(&x, &inputs[j], sizeof(x));
+			sum += f->avx512(x);
+		}
+	}
+	return sum[0];
+}
+
+static int kernel_vector_dependent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	switch (measure_vector_width()) {
+	case 512: return vector_dependent_avx512(data->function, ntimes) != 0.0;
+	case 256: return vector_dependent_avx2(data->function, ntimes) != 0.0;
+	default: return vector_dependent_sse(data->function, ntimes) != 0.0;
+	}
+}
+
+static int kernel_vector_independent(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	switch (measure_vector_width()) {
+	case 512: return vector_independent_avx512(data->function, data->inputs, ntimes) != 0.0;
+	case 256: return vector_independent_avx2(data->function, data->inputs, ntimes) != 0.0;
+	default: return vector_independent_sse(data->function, data->inputs, ntimes) != 0.0;
+	}
+}
+
+static int bench_init_function(void **benchdata, const function_t *function) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+	long i = 0;
+
+	data->function = function;
+
+	/* Allocate memory for the data arrays */
+	data->table = measure_aligned_alloc(ARRAY_SIZE * sizeof(*data->table), ARRAY_ALIGNMENT);
+	data->values = measure_aligned_alloc(ARRAY_SIZE * sizeof(*data->values), ARRAY_ALIGNMENT);
+	data->inputs = measure_aligned_alloc(ARRAY_SIZE * sizeof(*data->inputs), ARRAY_ALIGNMENT);
+
+	/* Fill with the data pattern selected with -d, the dividends with the top bit set */
+	measure_fill_int_array(data->table, ARRAY_SIZE, sizeof(*data->table));
+	measure_fill_float_array(data->values, ARRAY_SIZE, sizeof(*data->values));
+	for (i = 0; i < ARRAY_SIZE; i++) {
+		data->table[i] |= 1ULL << 63;
+		data->inputs[i] = 0.5 + (double)i / ARRAY_SIZE;
+	}
+
+	/* Success */
+	return 1;
+}
+
+static int bench_init(void **benchdata) {
+	return bench_init_function(benchdata, NULL);
+}
+
+static int bench_init_exp(void **benchdata) {
+	return bench_init_function(benchdata, &function_exp);
+}
+
+static int bench_init_log(void **benchdata) {
+	return bench_init_function(benchdata, &function_log);
+}
+
+static int bench_init_sin(void **benchdata) {
+	return bench_init_function(benchdata, &function_sin);
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	free(data->table);
+	free(data->values);
+	free(data->inputs);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench_div = {
+	.name = "longlat-div",
+	.init = bench_init,
+	.normal = kernel_div_dependent,
+	.extreme = kernel_div_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 40000,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+static measure_benchmark_t bench_idiv = {
+	.name = "longlat-idiv",
+	.init = bench_init,
+	.normal = kernel_idiv_dependent,
+	.extreme = kernel_idiv_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 40000,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+static measure_benchmark_t bench_divsd = {
+	.name = "longlat-divsd",
+	.init = bench_init,
+	.normal = kernel_divsd_dependent,
+	.extreme = kernel_divsd_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 100000,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+static measure_benchmark_t bench_sqrtpd = {
+	.name = "longlat-sqrtpd",
+	.init = bench_init,
+	.normal = kernel_sqrtpd_dependent,
+	.extreme = kernel_sqrtpd_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 100000,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+static measure_benchmark_t bench_exp = {
+	.name = "longlat-exp",
+	.init = bench_init_exp,
+	.normal = kernel_scalar_dependent,
+	.extreme = kernel_scalar_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 50000,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+static measure_benchmark_t bench_log = {
+	.name = "longlat-log",
+	.init = bench_init_log,
+	.normal = kernel_scalar_dependent,
+	.extreme = kernel_scalar_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 50000,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+static measure_benchmark_t bench_sin = {
+	.name = "longlat-sin",
+	.init = bench_init_sin,
+	.normal = kernel_scalar_dependent,
+	.extreme = kernel_scalar_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 50000,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+static measure_benchmark_t bench_exp_vector = {
+	.name = "longlat-exp-vector",
+	.init = bench_init_exp,
+	.normal = kernel_vector_dependent,
+	.extreme = kernel_vector_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 100000,
+	.vectorized = 1,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+static measure_benchmark_t bench_log_vector = {
+	.name = "longlat-log-vector",
+	.init = bench_init_log,
+	.normal = kernel_vector_dependent,
+	.extreme = kernel_vector_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 100000,
+	.vectorized = 1,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+static measure_benchmark_t bench_sin_vector = {
+	.name = "longlat-sin-vector",
+	.init = bench_init_sin,
+	.normal = kernel_vector_dependent,
+	.extreme = kernel_vector_independent,
+	.cleanup = bench_cleanup,
+	.ntimes = 100000,
+	.vectorized = 1,
+	.ops_per_iteration = ARRAY_SIZE,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench_div)
+MEASURE_REGISTER_BENCHMARK(bench_idiv)
+MEASURE_REGISTER_BENCHMARK(bench_divsd)
+MEASURE_REGISTER_BENCHMARK(bench_sqrtpd)
+MEASURE_REGISTER_BENCHMARK(bench_exp)
+MEASURE_REGISTER_BENCHMARK(bench_log)
+MEASURE_REGISTER_BENCHMARK(bench_sin)
+MEASURE_REGISTER_BENCHMARK(bench_exp_vector)
+MEASURE_REGISTER_BENCHMARK(bench_log_vector)
+MEASURE_REGISTER_BENCHMARK(bench_sin_vector)
@@ -0,0 +1,293 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * Loop stream detector (LSD) capacity sweep. The normal version runs a loop whose body has the given
+ * number of uops, including the fused loop branch, and is delivered by the LSD when it fits. The extreme
+ * version runs the same body unrolled 16 times, with an add in place of the loop branch between the
+ * copies, which is too large for the LSD and is delivered from the uop cache. Both versions execute
+ * the same number of uops. Sweeping the body size uop by uop with "-s 4:72:+1" shows the LSD capacity
+ * (28 uops per thread on Haswell with SMT, 56 without, 64 on Skylake) and the front-end power it saves.
+ *
+ * The fourth counter collects LSD:UOPS instead of the MS uops, so the idq_ms columns hold the LSD uops.
+ *
+ * Variants:
+ *   lsd-loop           no branches inside the body
+ *   lsd-loop-jmp1      one taken jump in the middle of the body
+ *   lsd-loop-jmp4      four taken jumps evenly spaced in the body
+ *   lsd-loop-jcc       one never taken conditional branch in the middle of the body
+ *
+ * Usage: ./idq-bench-lsd --run <variant> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -s <body from>:<to>:+<step> ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+#include "x86-jit.h"
+
+/*
+ * Uops executed per outer iteration by both versions, rounded down to a whole number of extreme
+ * loop iterations so that both versions execute the same number of uops.
+ */
+#define UOPS_PER_ITERATION	8192
+
+/*
+ * The extreme version unrolls the body this many times. 16 * 4 uops is already beyond the LSD.
+ * The adds are 7 bytes long, so every 32-byte window of the unrolled body takes a whole way of
+ * the uop cache. The 256 ways of Haswell hold 8 kB of code, i.e. bodies up to about 72 uops,
+ * and larger bodies partly run from the legacy decoders.
+ */
+#define EXTREME_UNROLL	16
+
+/*
+ * Smallest body: the loop branch and at least three other uops.
+ */
+#define MIN_BODY_UOPS	4
+
+/*
+ * Default body size in uops, fits in the LSD of every generation.
+ */
+#define DEFAULT_BODY_UOPS	24
+
+/*
+ * Number of independent dependency chains.
+ */
+#define CHAINS		6
+
+/*
+ * Loop structure: rdi = outer counter, rcx = inner counter, rax/rdx/r8-r11 = accumulators.
+ */
+static const jit_reg_t chain_regs[CHAINS] = { JIT_RAX, JIT_RDX, JIT_R8, JIT_R9, JIT_R10, JIT_R11 };
+
+typedef enum {
+	BRANCH_NONE = 0, BRANCH_JMP, BRANCH_JCC
+} branch_t;
+
+typedef struct {
+	branch_t branch;
+	int num_branches;
+} variant_t;
+
+static const variant_t variant_loop = { BRANCH_NONE, 0 };
+static const variant_t variant_jmp1 = { BRANCH_JMP, 1 };
+static const variant_t variant_jmp4 = { BRANCH_JMP, 4 };
+static const variant_t variant_jcc = { BRANCH_JCC, 1 };
+
+/*
+ * Emit the body without the loop branch: uops - 1 single-uop instructions, with the branches
+ * evenly spaced among them. A taken jump is one of those uops, while a conditional branch
+ * macro-fuses with the preceding add and comes on top of them.
+ */
+static void emit_body(jit_buffer_t *jit, const variant_t *variant, long uops) {
+	long k = 0, next_branch = 0, branch_spacing = uops / (variant->num_branches + 1);
+	int chain = 0, branches = 0;
+
+	next_branch = branch_spacing;
+	for (k = 0; k < uops - 1; k++) {
+		if (branches < variant->num_branches && k == next_branch) {
+			branches++;
+			next_branch += branch_spacing;
+			if (variant->branch == BRANCH_JMP) {
+				/* Taken jump to the next instruction */
+				jit_jmp(jit, jit->len + 5);
+				continue;
+			}
+			/* Fused with the preceding add, which never produces zero, so an add still takes this slot */
+			jit_jz(jit, jit->len + 6);
+		}
+		jit_alu_r64_imm32(jit, JIT_ALU_ADD, chain_regs[chain], 1);
+		chain = (chain + 1) % CHAINS;
+	}
+}
+
+/*
+ * Generate the kernel: for (i = 0; i < ntimes; i++) for (j = 0; j < inner_iters; j++) { body x unroll }
+ * Every copy of the body but the last ends with an add in place of the loop branch, so an inner
+ * iteration runs unroll * uops uops.
+ */
+static int generate_kernel(jit_buffer_t *jit, const variant_t *variant, long uops, long unroll, long inner_iters) {
+	long k = 0;
+	int chain = 0;
+
+	if (!jit_alloc(jit, (uops * unroll * 8 + 4096 + 4095) & ~4095L)) {
+		return 0;
+	}
+	for (chain = 0; chain < CHAINS; chain++) {
+		jit_xor_r32_r32(jit, chain_regs[chain], chain_regs[chain]);
+	}
+	size_t outer = jit_label(jit);
+	jit_mov_r64_imm64(jit, JIT_RCX, inner_iters);
+	size_t inner = jit_label(jit);
+	for (k = 0; k < unroll; k++) {
+		emit_body(jit, variant, uops);
+		if (k < unroll - 1) {
+			jit_alu_r64_imm32(jit, JIT_ALU_ADD, chain_regs[k % CHAINS], 1);
+		}
+	}
+	/* dec and jnz are fused into a single uop */
+	jit_dec_r64(jit, JIT_RCX);
+	jit_jnz(jit, inner);
+	jit_dec_r64(jit, JIT_RDI);
+	jit_jnz(jit, outer);
+	for (chain = 1; chain < CHAINS; chain++) {
+		jit_add_r64_r64(jit, JIT_RAX, chain_regs[chain]);
+	}
+	jit_ret(jit);
+	return jit_finalize(jit);
+}
+
+typedef struct {
+	const variant_t *variant;
+	jit_buffer_t normal;
+	jit_buffer_t extreme;
+} benchdata_t;
+
+/*
+ * Regenerate both kernels for the requested body size in uops.
+ */
+static long bench_set_param(void *benchdata, long uops) {
+	benchdata_t *data = benchdata;
+	long extreme_iters = UOPS_PER_ITERATION / (uops * EXTREME_UNROLL) > 0 ? UOPS_PER_ITERATION / (uops * EXTREME_UNROLL) : 1;
+
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	if (uops < MIN_BODY_UOPS + data->variant->num_branches ||
+	    !generate_kernel(&data->normal, data->variant, uops, 1, EXTREME_UNROLL * extreme_iters) ||
+	    !generate_kernel(&data->extreme, data->variant, uops, EXTREME_UNROLL, extreme_iters)) {
+		return -1;
+	}
+	return uops;
+}
+
+static int bench_init_variant(void **benchdata, const variant_t *variant) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	data->variant = variant;
+	return bench_set_param(data, DEFAULT_BODY_UOPS) > 0;
+}
+
+static int bench_init_loop(void **benchdata) {
+	return bench_init_variant(benchdata, &variant_loop);
+}
+
+static int bench_init_jmp1(void **benchdata) {
+	return bench_init_variant(benchdata, &variant_jmp1);
+}
+
+static int bench_init_jmp4(void **benchdata) {
+	return bench_init_variant(benchdata, &variant_jmp4);
+}
+
+static int bench_init_jcc(void **benchdata) {
+	return bench_init_variant(benchdata, &variant_jcc);
+}
+
+static int bench_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->normal.code)(ntimes, NULL);
+}
+
+static int bench_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->extreme.code)(ntimes, NULL);
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+#define LSD_COUNTERS { { NULL, NULL }, { NULL, NULL }, { NULL, NULL }, { "LSD:UOPS", "LSD uops:" } }
+
+static measure_benchmark_t bench_loop = {
+	.name = "lsd-loop",
+	.init = bench_init_loop,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.counters = LSD_COUNTERS,
+	.ntimes = 1000000,
+	.set_param = bench_set_param,
+	.param_name = "body_uops",
+	.param_default = 0,
+};
+
+static measure_benchmark_t bench_jmp1 = {
+	.name = "lsd-loop-jmp1",
+	.init = bench_init_jmp1,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.counters = LSD_COUNTERS,
+	.ntimes = 1000000,
+	.set_param = bench_set_param,
+	.param_name = "body_uops",
+	.param_default = 0,
+};
+
+static measure_benchmark_t bench_jmp4 = {
+	.name = "lsd-loop-jmp4",
+	.init = bench_init_jmp4,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.counters = LSD_COUNTERS,
+	.ntimes = 250000,
+	.set_param = bench_set_param,
+	.param_name = "body_uops",
+	.param_default = 0,
+};
+
+static measure_benchmark_t bench_jcc = {
+	.name = "lsd-loop-jcc",
+	.init = bench_init_jcc,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.counters = LSD_COUNTERS,
+	.ntimes = 1000000,
+	.set_param = bench_set_param,
+	.param_name = "body_uops",
+	.param_default = 0,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench_loop)
+MEASURE_REGISTER_BENCHMARK(bench_jmp1)
+MEASURE_REGISTER_BENCHMARK(bench_jmp4)
+MEASURE_REGISTER_BENCHMARK(bench_jcc)
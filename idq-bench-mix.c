@@ -0,0 +1,138 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * The kernel is synthesized at runtime from an instruction mix file, see mix-synth.h for the format and
+ * the mixes directory for examples. The loop body size can be swept in instructions with -s.
+ *
+ * Usage: ./idq-bench-mix -f <mix file> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ] [ -s <body from>:<to>[:<factor>] ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+#include "mix-synth.h"
+
+/*
+ * Align arrays to a 2 MB boundary.
+ */
+#define ARRAY_ALIGNMENT	2097152
+
+/*
+ * Loop enough times to make the power consumption measurable. Every outer iteration of either version
+ * executes the same number of instructions, MIX_INSNS_PER_ITERATION at the default body size regardless of the mix.
+ */
+#define NTIMES		300000
+
+typedef struct {
+	mix_t mix;
+	uint64_t *a;
+	jit_buffer_t normal;
+	jit_buffer_t extreme;
+} benchdata_t;
+
+/*
+ * Regenerate both kernels for the requested number of instructions in the normal loop body. The normal
+ * body runs twice as many times as the extreme body, so both execute the same number of instructions.
+ */
+static long bench_set_param(void *benchdata, long body) {
+	benchdata_t *data = benchdata;
+
+	if (body < 1) {
+		return -1;
+	}
+	long extreme_iters = MIX_INSNS_PER_ITERATION / (2 * body) > 0 ? MIX_INSNS_PER_ITERATION / (2 * body) : 1;
+
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	if (!mix_generate(&data->normal, &data->mix, body, 2 * extreme_iters) || !mix_generate(&data->extreme, &data->mix, 2 * body, extreme_iters)) {
+		return -1;
+	}
+	return body;
+}
+
+static int bench_init(void **benchdata) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	if (arg_input_file == NULL) {
+		fprintf(stderr, "Error: No mix file given, use -f <file>.\n");
+		return 0;
+	}
+	if (!mix_parse_file(arg_input_file, &data->mix)) {
+		return 0;
+	}
+
+	/* Allocate memory for the data array */
+	data->a = measure_aligned_alloc(MIX_ARRAY_SIZE * sizeof(*data->a), ARRAY_ALIGNMENT);
+
+	/* Fill with the data pattern selected with -d, as doubles for the SSE templates */
+	measure_fill_float_array(data->a, MIX_ARRAY_SIZE, sizeof(double));
+
+	return bench_set_param(data, data->mix.body) > 0;
+}
+
+static int bench_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->normal.code)(ntimes, data->a);
+}
+
+static int bench_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	if (ntimes <= 0) return 0;
+	return ((jit_kernel_t)data->extreme.code)(ntimes, data->a);
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	jit_free(&data->normal);
+	jit_free(&data->extreme);
+	free(data->a);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench = {
+	.name = "mix",
+	.init = bench_init,
+	.normal = bench_normal,
+	.extreme = bench_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = NTIMES,
+	.set_param = bench_set_param,
+	.param_name = "body_insns",
+	.param_default = 0,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench)
@@ -0,0 +1,477 @@
+/*
+ * Benchmark designed to stress the microcode sequencer. Designed for Intel Haswell microarchitecture.
+ *
+ * The extreme version of every benchmark is dominated by instructions whose uops are delivered by the
+ * microcode sequencer (MS), and the normal version does the same work with simple instructions which are
+ * decoded by MITE or delivered from the uop cache. Together with the MS uops column this allows
+ * estimating the energy per MS uop.
+ *
+ *   ms-rep-movsb       rep movsb vs. a loop of 8-byte moves, the copy length in bytes can be swept with -s
+ *   ms-rep-stosb       rep stosb vs. a loop of 8-byte stores, the length in bytes can be swept with -s
+ *   ms-repe-cmpsb      repe cmpsb vs. a loop of 8-byte compares on two equal buffers, sweepable with -s
+ *   ms-xchg-mem        xchg with memory (implicitly locked) vs. the same swap with three moves
+ *   ms-div             64-bit div vs. division by multiplication with the reciprocal
+ *   ms-bt-mem          bt with a register bit offset into memory vs. address computation, load and bt r64, r64
+ *   ms-denormal        double precision multiply-add with denormal vs. normal inputs, denormals need microcode assists
+ *
+ * Usage: ./idq-bench-ms --run <benchmark> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+
+/*
+ * Number of elements in the data arrays.
+ * 2048 elements/array * 8 bytes/element = 16 kB
+ */
+#define ARRAY_SIZE	2048
+
+/*
+ * Align arrays to a 2 MB boundary.
+ */
+#define ARRAY_ALIGNMENT	2097152
+
+/*
+ * Default length of the string operations in bytes.
+ */
+#define DEFAULT_STRING_LENGTH	256
+
+/*
+ * Denormal inputs for ms-denormal, the products are denormal as well.
+ */
+#define DENORMAL_VALUE	1e-310
+
+typedef struct {
+	uint8_t *src;
+	uint8_t *dst;
+	long length;
+	uint64_t *table;
+	double *normal_values;
+	double *denormal_values;
+} benchdata_t;
+
+/*
+ * String kernels. The reference loops move 8 bytes per iteration, the lengths are multiples of 8.
+ */
+static int kernel_copy_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0;
+	for (i = 0; i < ntimes; i++) {
+		long offset = 0, tmp = 0;
+		__asm__ __volatile__(
+			"1:\n\t"
+			"mov (%[src],%[offset]), %[tmp]\n\t"
+			"mov %[tmp], (%[dst],%[offset])\n\t"
+			"add $8, %[offset]\n\t"
+			"cmp %[length], %[offset]\n\t"
+			"jb 1b"
+			: [offset] "+r" (offset), [tmp] "=&r" (tmp)
+			: [src] "r" (data->src), [dst] "r" (data->dst), [length] "r" (data->length)
+			: "cc", "memory");
+	}
+	return data->dst[0];
+}
+
+static int kernel_copy_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0;
+	for (i = 0; i < ntimes; i++) {
+		void *src = data->src, *dst = data->dst;
+		long count = data->length;
+		__asm__ __volatile__(
+			"rep movsb"
+			: "+S" (src), "+D" (dst), "+c" (count)
+			:
+			: "memory");
+	}
+	return data->dst[0];
+}
+
+static int kernel_fill_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0;
+	for (i = 0; i < ntimes; i++) {
+		long offset = 0;
+		__asm__ __volatile__(
+			"1:\n\t"
+			"mov %[value], (%[dst],%[offset])\n\t"
+			"add $8, %[offset]\n\t"
+			"cmp %[length], %[offset]\n\t"
+			"jb 1b"
+			: [offset] "+r" (offset)
+			: [value] "r" (i), [dst] "r" (data->dst), [length] "r" (data->length)
+			: "cc", "memory");
+	}
+	return data->dst[0];
+}
+
+static int kernel_fill_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0;
+	for (i = 0; i < ntimes; i++) {
+		void *dst = data->dst;
+		long count = data->length;
+		__asm__ __volatile__(
+			"rep stosb"
+			: "+D" (dst), "+c" (count)
+			: "a" (i)
+			: "memory");
+	}
+	return data->dst[0];
+}
+
+static int kernel_compare_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, equal = 0;
+	for (i = 0; i < ntimes; i++) {
+		long offset = 0, tmp = 0;
+		__asm__ __volatile__(
+			"1:\n\t"
+			"mov (%[src],%[offset]), %[tmp]\n\t"
+			"cmp (%[dst],%[offset]), %[tmp]\n\t"
+			"jne 2f\n\t"
+			"add $8, %[offset]\n\t"
+			"cmp %[length], %[offset]\n\t"
+			"jb 1b\n"
+			"2:"
+			: [offset] "+r" (offset), [tmp] "=&r" (tmp)
+			: [src] "r" (data->src), [dst] "r" (data->dst), [length] "r" (data->length)
+			: "cc", "memory");
+		equal += offset;
+	}
+	return equal;
+}
+
+static int kernel_compare_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, equal = 0;
+	for (i = 0; i < ntimes; i++) {
+		void *src = data->src, *dst = data->dst;
+		long count = data->length;
+		__asm__ __volatile__(
+			"repe cmpsb"
+			: "+S" (src), "+D" (dst), "+c" (count)
+			:
+			: "cc", "memory");
+		equal += count;
+	}
+	return equal;
+}
+
+/*
+ * xchg with a memory operand is implicitly locked and takes 8 uops.
+ */
+static int kernel_xchg_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, value = 1, tmp = 0;
+	for (i = 0; i < ntimes; i++) {
+		__asm__ __volatile__(
+			".rept 64\n\t"
+			"mov (%[table]), %[tmp]\n\t"
+			"mov %[value], (%[table])\n\t"
+			"mov %[tmp], %[value]\n\t"
+			"mov 8(%[table]), %[tmp]\n\t"
+			"mov %[value], 8(%[table])\n\t"
+			"mov %[tmp], %[value]\n\t"
+			".endr"
+			: [value] "+r" (value), [tmp] "=&r" (tmp)
+			: [table] "r" (data->table)
+			: "memory");
+	}
+	return value;
+}
+
+static int kernel_xchg_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, value = 1;
+	for (i = 0; i < ntimes; i++) {
+		__asm__ __volatile__(
+			".rept 64\n\t"
+			"xchg %[value], (%[table])\n\t"
+			"xchg %[value], 8(%[table])\n\t"
+			".endr"
+			: [value] "+r" (value)
+			: [table] "r" (data->table)
+			: "memory");
+	}
+	return value;
+}
+
+/*
+ * Unsigned division by 5. The reference uses the reciprocal 0xcccccccccccccccd, which is exact for
+ * every 64-bit dividend.
+ */
+static int kernel_div_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	uint64_t sum = 0, rax = 0, rdx = 0;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 4) {
+			__asm__ (
+				".irp k,0,1,2,3\n\t"
+				"mov \\k*8(%[a]), %%rax\n\t"
+				"mul %[reciprocal]\n\t"
+				"shr $2, %%rdx\n\t"
+				"add %%rdx, %[sum]\n\t"
+				".endr"
+				: [sum] "+r" (sum), "=&a" (rax), "=&d" (rdx)
+				: [a] "r" (&data->table[j]), [reciprocal] "r" (0xcccccccccccccccdULL)
+				: "cc", "memory");
+		}
+	}
+	return sum;
+}
+
+static int kernel_div_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	uint64_t sum = 0, rax = 0, rdx = 0;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j += 4) {
+			__asm__ (
+				".irp k,0,1,2,3\n\t"
+				"mov \\k*8(%[a]), %%rax\n\t"
+				"xor %%edx, %%edx\n\t"
+				"div %[divisor]\n\t"
+				"add %%rax, %[sum]\n\t"
+				".endr"
+				: [sum] "+r" (sum), "=&a" (rax), "=&d" (rdx)
+				: [a] "r" (&data->table[j]), [divisor] "r" (5ULL)
+				: "cc", "memory");
+		}
+	}
+	return sum;
+}
+
+/*
+ * Bit tests over a 16 kB table with a pseudo-random bit offset.
+ */
+static int kernel_bt_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, count = 0, bit = 0, tmp = 0;
+	for (i = 0; i < ntimes; i++) {
+		__asm__ (
+			".rept 64\n\t"
+			"add $8191, %[bit]\n\t"
+			"and $131071, %[bit]\n\t"
+			"mov %[bit], %[tmp]\n\t"
+			"shr $6, %[tmp]\n\t"
+			"mov (%[table],%[tmp],8), %[tmp]\n\t"
+			"bt %[bit], %[tmp]\n\t"
+			"adc $0, %[count]\n\t"
+			".endr"
+			: [count] "+r" (count), [bit] "+r" (bit), [tmp] "=&r" (tmp)
+			: [table] "r" (data->table)
+			: "cc", "memory");
+	}
+	return count;
+}
+
+static int kernel_bt_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, count = 0, bit = 0;
+	for (i = 0; i < ntimes; i++) {
+		__asm__ (
+			".rept 64\n\t"
+			"add $8191, %[bit]\n\t"
+			"and $131071, %[bit]\n\t"
+			"bt %[bit], (%[table])\n\t"
+			"adc $0, %[count]\n\t"
+			".endr"
+			: [count] "+r" (count), [bit] "+r" (bit)
+			: [table] "r" (data->table)
+			: "cc", "memory");
+	}
+	return count;
+}
+
+/*
+ * The same code for both versions, only the inputs differ.
+ */
+static double kernel_multiply_add(long ntimes, const double *a) {
+	long i = 0, j = 0;
+	double sum = 0.0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < ARRAY_SIZE; j++) {
+			sum += a[j] * 0.5;
+		}
+	}
+	return sum;
+}
+
+static int kernel_denormal_normal(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	return kernel_multiply_add(ntimes, data->normal_values) != 0.0;
+}
+
+static int kernel_denormal_extreme(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	return kernel_multiply_add(ntimes, data->denormal_values) != 0.0;
+}
+
+/*
+ * Reallocate the string buffers. The length is rounded up to a multiple of 8 bytes.
+ */
+static long bench_set_length(void *benchdata, long length) {
+	benchdata_t *data = benchdata;
+	long i = 0;
+
+	length = (length + 7) & ~7L;
+	if (length <= 0) {
+		return -1;
+	}
+	free(data->src);
+	free(data->dst);
+	data->src = measure_aligned_alloc(length, ARRAY_ALIGNMENT);
+	data->dst = measure_aligned_alloc(length, ARRAY_ALIGNMENT);
+	data->length = length;
+
+	/* Equal contents so that the compare kernels scan the whole buffer */
+	for (i = 0; i < length; i++) {
+		data->src[i] = data->dst[i] = rand32();
+	}
+	return length;
+}
+
+static int bench_init(void **benchdata) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+	long i = 0;
+
+	/* Allocate memory for the data arrays */
+	data->table = measure_aligned_alloc(ARRAY_SIZE * sizeof(*data->table), ARRAY_ALIGNMENT);
+	data->normal_values = measure_aligned_alloc(ARRAY_SIZE * sizeof(*data->normal_values), ARRAY_ALIGNMENT);
+	data->denormal_values = measure_aligned_alloc(ARRAY_SIZE * sizeof(*data->denormal_values), ARRAY_ALIGNMENT);
+
+	/* Fill with random numbers */
+	for (i = 0; i < ARRAY_SIZE; i++) {
+		data->table[i] = arg_use_64bit_numbers ? rand64() : rand32();
+		data->normal_values[i] = 1.0 + (double)rand32() / UINT32_MAX;
+		data->denormal_values[i] = DENORMAL_VALUE * data->normal_values[i];
+	}
+
+	return bench_set_length(data, DEFAULT_STRING_LENGTH) > 0;
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	free(data->src);
+	free(data->dst);
+	free(data->table);
+	free(data->normal_values);
+	free(data->denormal_values);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+static measure_benchmark_t bench_rep_movsb = {
+	.name = "ms-rep-movsb",
+	.init = bench_init,
+	.normal = kernel_copy_normal,
+	.extreme = kernel_copy_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 60000000,
+	.set_param = bench_set_length,
+	.param_name = "length_bytes",
+	.param_default = DEFAULT_STRING_LENGTH,
+};
+
+static measure_benchmark_t bench_rep_stosb = {
+	.name = "ms-rep-stosb",
+	.init = bench_init,
+	.normal = kernel_fill_normal,
+	.extreme = kernel_fill_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 60000000,
+	.set_param = bench_set_length,
+	.param_name = "length_bytes",
+	.param_default = DEFAULT_STRING_LENGTH,
+};
+
+static measure_benchmark_t bench_repe_cmpsb = {
+	.name = "ms-repe-cmpsb",
+	.init = bench_init,
+	.normal = kernel_compare_normal,
+	.extreme = kernel_compare_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 20000000,
+	.set_param = bench_set_length,
+	.param_name = "length_bytes",
+	.param_default = DEFAULT_STRING_LENGTH,
+};
+
+static measure_benchmark_t bench_xchg_mem = {
+	.name = "ms-xchg-mem",
+	.init = bench_init,
+	.normal = kernel_xchg_normal,
+	.extreme = kernel_xchg_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 1000000,
+};
+
+static measure_benchmark_t bench_div = {
+	.name = "ms-div",
+	.init = bench_init,
+	.normal = kernel_div_normal,
+	.extreme = kernel_div_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 130000,
+};
+
+static measure_benchmark_t bench_bt_mem = {
+	.name = "ms-bt-mem",
+	.init = bench_init,
+	.normal = kernel_bt_normal,
+	.extreme = kernel_bt_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 5000000,
+};
+
+static measure_benchmark_t bench_denormal = {
+	.name = "ms-denormal",
+	.init = bench_init,
+	.normal = kernel_denormal_normal,
+	.extreme = kernel_denormal_extreme,
+	.cleanup = bench_cleanup,
+	.ntimes = 17000,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench_rep_movsb)
+MEASURE_REGISTER_BENCHMARK(bench_rep_stosb)
+MEASURE_REGISTER_BENCHMARK(bench_repe_cmpsb)
+MEASURE_REGISTER_BENCHMARK(bench_xchg_mem)
+MEASURE_REGISTER_BENCHMARK(bench_div)
+MEASURE_REGISTER_BENCHMARK(bench_bt_mem)
+MEASURE_REGISTER_BENCHMARK(bench_denormal)
@@ -0,0 +1,322 @@
+/*
+ * Benchmark designed to stress the instruction decoders. Designed for Intel Haswell microarchitecture.
+ *
+ * Execution port pressure. The extreme version of every benchmark saturates one group of execution
+ * ports with independent single-uop instructions. The normal version executes multi-byte NOPs of the
+ * same length and number instead, which are decoded, issued and retired like the real instructions
+ * but never dispatched to a port, so the difference between the two is the energy of the ports.
+ *
+ *   ports-alu            add reg, imm on eight registers, ports 0, 1, 5 and 6
+ *   ports-load           64-bit loads, ports 2 and 3
+ *   ports-store-data     64-bit stores with an indexed address, data on port 4 and address on ports 2 and 3
+ *   ports-store-address  64-bit stores with a base + displacement address, data on port 4 and address on port 7
+ *   ports-shuffle        pshufd on eight xmm registers, port 5
+ *
+ * A store is always split into a store-address and a store-data uop, so port 7 cannot be loaded
+ * without port 4. The two store benchmarks differ in which port takes the address.
+ *
+ * The counters collect UOPS_DISPATCHED_PORT events instead of the front-end uops: ports 0, 1, 5 and 6
+ * for ports-alu, ports 2, 3, 4 and 7 for the load and store benchmarks, and uops issued and ports 0, 1
+ * and 5 for ports-shuffle, in the four counter columns of the CSV output.
+ *
+ * Usage: ./idq-bench-ports --run <benchmark> [ -b ] [ -m ] [ -n <running time multiplier> ] [ -r <number of times to repeat> ]
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "measure-util.h"
+
+/*
+ * Every inline assembly block executes 64 instructions, and every outer iteration 64 blocks.
+ * The 4 or 5 bytes per instruction keep a block well within the uop cache.
+ */
+#define INSNS_PER_BLOCK		64
+#define BLOCKS_PER_ITERATION	64
+#define INSNS_PER_ITERATION	(INSNS_PER_BLOCK * BLOCKS_PER_ITERATION)
+
+/*
+ * Number of elements in the data array, 8 bytes each.
+ */
+#define ARRAY_SIZE	512
+
+/*
+ * Align arrays to a 2 MB boundary.
+ */
+#define ARRAY_ALIGNMENT	2097152
+
+typedef struct {
+	uint64_t *array;
+} benchdata_t;
+
+/*
+ * NOPs with a non-zero 8-bit displacement, so that they have the same length as the instructions
+ * they replace: 4 bytes without an index and 5 bytes with one.
+ */
+static int kernel_nop4(void *benchdata, long ntimes) {
+	long i = 0, j = 0;
+	(void)benchdata;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < BLOCKS_PER_ITERATION; j++) {
+			__asm__ __volatile__ (
+				".rept 64\n\t"
+				"nopl 8(%%rax)\n\t"
+				".endr"
+				:
+				:);
+		}
+	}
+	return 1;
+}
+
+static int kernel_nop5(void *benchdata, long ntimes) {
+	long i = 0, j = 0;
+	(void)benchdata;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < BLOCKS_PER_ITERATION; j++) {
+			__asm__ __volatile__ (
+				".rept 64\n\t"
+				"nopl 8(%%rax,%%rax,1)\n\t"
+				".endr"
+				:
+				:);
+		}
+	}
+	return 1;
+}
+
+/*
+ * Eight independent chains of 64-bit adds, 4 bytes each.
+ */
+static int kernel_alu(void *benchdata, long ntimes) {
+	uint64_t r0 = 0, r1 = 0, r2 = 0, r3 = 0, r4 = 0, r5 = 0, r6 = 0, r7 = 0;
+	long i = 0, j = 0;
+	(void)benchdata;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < BLOCKS_PER_ITERATION; j++) {
+			__asm__ (
+				".rept 8\n\t"
+				"add $1, %[r0]\n\t"
+				"add $1, %[r1]\n\t"
+				"add $1, %[r2]\n\t"
+				"add $1, %[r3]\n\t"
+				"add $1, %[r4]\n\t"
+				"add $1, %[r5]\n\t"
+				"add $1, %[r6]\n\t"
+				"add $1, %[r7]\n\t"
+				".endr"
+				: [r0] "+r" (r0), [r1] "+r" (r1), [r2] "+r" (r2), [r3] "+r" (r3),
+				  [r4] "+r" (r4), [r5] "+r" (r5), [r6] "+r" (r6), [r7] "+r" (r7)
+				:
+				: "cc");
+		}
+	}
+	return r0 + r1 + r2 + r3 + r4 + r5 + r6 + r7;
+}
+
+/*
+ * Loads from the same cache line into rotating registers, 4 bytes each with rsi as the base.
+ */
+static int kernel_load(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < BLOCKS_PER_ITERATION; j++) {
+			__asm__ __volatile__ (
+				".rept 8\n\t"
+				".irp k,1,2,3,4,5,6,7,8\n\t"
+				"mov \\k*8(%%rsi), %%rax\n\t"
+				".endr\n\t"
+				".endr"
+				:
+				: "S" (data->array)
+				: "rax", "memory");
+		}
+	}
+	return 1;
+}
+
+/*
+ * Stores with an index register, so that the address goes to ports 2 and 3, 5 bytes each.
+ */
+static int kernel_store_data(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < BLOCKS_PER_ITERATION; j++) {
+			__asm__ __volatile__ (
+				".rept 8\n\t"
+				".irp k,1,2,3,4,5,6,7,8\n\t"
+				"mov %%rax, \\k*8(%%rsi,%%rdi,8)\n\t"
+				".endr\n\t"
+				".endr"
+				:
+				: "S" (data->array), "D" (0L), "a" (i)
+				: "memory");
+		}
+	}
+	return 1;
+}
+
+/*
+ * Stores with a base and a displacement, which port 7 can handle, 4 bytes each.
+ */
+static int kernel_store_address(void *benchdata, long ntimes) {
+	benchdata_t *data = benchdata;
+	long i = 0, j = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < BLOCKS_PER_ITERATION; j++) {
+			__asm__ __volatile__ (
+				".rept 8\n\t"
+				".irp k,1,2,3,4,5,6,7,8\n\t"
+				"mov %%rax, \\k*8(%%rsi)\n\t"
+				".endr\n\t"
+				".endr"
+				:
+				: "S" (data->array), "a" (i)
+				: "memory");
+		}
+	}
+	return 1;
+}
+
+/*
+ * Shuffles on eight independent xmm registers, 5 bytes each without a REX prefix.
+ */
+static int kernel_shuffle(void *benchdata, long ntimes) {
+	long i = 0, j = 0;
+	(void)benchdata;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < BLOCKS_PER_ITERATION; j++) {
+			__asm__ __volatile__ (
+				".rept 8\n\t"
+				".irp k,0,1,2,3,4,5,6,7\n\t"
+				"pshufd $0x1b, %%xmm\\k, %%xmm\\k\n\t"
+				".endr\n\t"
+				".endr"
+				:
+				:
+				: "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7");
+		}
+	}
+	return 1;
+}
+
+static int bench_init(void **benchdata) {
+	benchdata_t *data = calloc(1, sizeof(benchdata_t));
+	*benchdata = data;
+
+	/* Allocate memory for the data array */
+	data->array = measure_aligned_alloc(ARRAY_SIZE * sizeof(*data->array), ARRAY_ALIGNMENT);
+
+	/* Fill with the data pattern selected with -d */
+	measure_fill_int_array(data->array, ARRAY_SIZE, sizeof(*data->array));
+
+	/* Success */
+	return 1;
+}
+
+static int bench_cleanup(void *benchdata) {
+	benchdata_t *data = benchdata;
+	free(data->array);
+	free(data);
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Benchmark registration
+ */
+#define ALU_PORT_COUNTERS { { "UOPS_DISPATCHED_PORT:PORT_0", "Port 0 uops:" }, { "UOPS_DISPATCHED_PORT:PORT_1", "Port 1 uops:" }, \
+                            { "UOPS_DISPATCHED_PORT:PORT_5", "Port 5 uops:" }, { "UOPS_DISPATCHED_PORT:PORT_6", "Port 6 uops:" } }
+#define MEMORY_PORT_COUNTERS { { "UOPS_DISPATCHED_PORT:PORT_2", "Port 2 uops:" }, { "UOPS_DISPATCHED_PORT:PORT_3", "Port 3 uops:" }, \
+                               { "UOPS_DISPATCHED_PORT:PORT_4", "Port 4 uops:" }, { "UOPS_DISPATCHED_PORT:PORT_7", "Port 7 uops:" } }
+#define VECTOR_PORT_COUNTERS { { NULL, NULL }, { "UOPS_DISPATCHED_PORT:PORT_0", "Port 0 uops:" }, \
+                               { "UOPS_DISPATCHED_PORT:PORT_1", "Port 1 uops:" }, { "UOPS_DISPATCHED_PORT:PORT_5", "Port 5 uops:" } }
+
+static measure_benchmark_t bench_alu = {
+	.name = "ports-alu",
+	.init = bench_init,
+	.normal = kernel_nop4,
+	.extreme = kernel_alu,
+	.cleanup = bench_cleanup,
+	.counters = ALU_PORT_COUNTERS,
+	.ntimes = 1000000,
+	.ops_per_iteration = INSNS_PER_ITERATION,
+};
+
+static measure_benchmark_t bench_load = {
+	.name = "ports-load",
+	.init = bench_init,
+	.normal = kernel_nop4,
+	.extreme = kernel_load,
+	.cleanup = bench_cleanup,
+	.counters = MEMORY_PORT_COUNTERS,
+	.ntimes = 500000,
+	.ops_per_iteration = INSNS_PER_ITERATION,
+};
+
+static measure_benchmark_t bench_store_data = {
+	.name = "ports-store-data",
+	.init = bench_init,
+	.normal = kernel_nop5,
+	.extreme = kernel_store_data,
+	.cleanup = bench_cleanup,
+	.counters = MEMORY_PORT_COUNTERS,
+	.ntimes = 250000,
+	.ops_per_iteration = INSNS_PER_ITERATION,
+};
+
+static measure_benchmark_t bench_store_address = {
+	.name = "ports-store-address",
+	.init = bench_init,
+	.normal = kernel_nop4,
+	.extreme = kernel_store_address,
+	.cleanup = bench_cleanup,
+	.counters = MEMORY_PORT_COUNTERS,
+	.ntimes = 250000,
+	.ops_per_iteration = INSNS_PER_ITERATION,
+};
+
+static measure_benchmark_t bench_shuffle = {
+	.name = "ports-shuffle",
+	.init = bench_init,
+	.normal = kernel_nop5,
+	.extreme = kernel_shuffle,
+	.cleanup = bench_cleanup,
+	.counters = VECTOR_PORT_COUNTERS,
+	.ntimes = 250000,
+	.ops_per_iteration = INSNS_PER_ITERATION,
+};
+
+MEASURE_REGISTER_BENCHMARK(bench_alu)
+MEASURE_REGISTER_BENCHMARK(bench_load)
+MEASURE_REGISTER_BENCHMARK(bench_store_data)
+MEASURE_REGISTER_BENCHMARK(bench_store_address)
+MEASURE_REGISTER_BENCHMARK(bench_shuffle)
@@ -0,0 +1,791 @@
+/*
+ * Header-only C++ library of array benchmark kernels. Every kernel is a template over
+ * the element type, the operation, the array length and the unroll count, so the whole
+ * matrix of (operation x data type x working set x unroll factor) can be instantiated
+ * at build time instead of writing one C file per combination.
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef KERNEL_MATRIX_HPP
+#define KERNEL_MATRIX_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "measure-util.h"
+
+/*
+ * The element accessors return vectors wider than the default target. They are always inlined
+ * into kernels compiled for the matching target, so the ABI change GCC warns about never applies.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace kernel_matrix {
+
+#define KERNEL_INLINE inline __attribute__((always_inline))
+
+/*
+ * Align arrays to a 2 MB boundary.
+ */
+static const size_t array_alignment = 2097152;
+
+/*
+ * Number of elements processed in one sample. Chosen to make one sample last roughly one second,
+ * like the NTIMES values of the C benchmarks.
+ */
+static const long elements_per_sample = 1240000000L;
+
+/*
+ * Data arrays and the scalar operand passed to the kernels.
+ */
+template <typename T>
+struct arrays_t {
+	T *a;
+	T *b;
+	T *c;
+	T *d;
+	T scalar;
+};
+
+/*
+ * Data types. The names match the naming of the C benchmarks.
+ */
+template <typename T> struct type_traits;
+template <> struct type_traits<double> {
+	static const char *name() { return "float"; }
+	static const bool is_integer = false;
+};
+template <> struct type_traits<float> {
+	static const char *name() { return "float32"; }
+	static const bool is_integer = false;
+};
+template <> struct type_traits<unsigned long long> {
+	static const char *name() { return "int"; }
+	static const bool is_integer = true;
+};
+template <> struct type_traits<unsigned int> {
+	static const char *name() { return "int32"; }
+	static const bool is_integer = true;
+};
+template <> struct type_traits<unsigned short> {
+	static const char *name() { return "int16"; }
+	static const bool is_integer = true;
+};
+template <> struct type_traits<unsigned char> {
+	static const char *name() { return "int8"; }
+	static const bool is_integer = true;
+};
+
+/*
+ * Element accessors shared by the scalar and vector kernels. S is either T itself or a vector of T,
+ * in which case j is the index of the first lane.
+ */
+template <typename S, typename T>
+static KERNEL_INLINE S load(const T *p, long j) {
+	S v;
+	memcpy(&v, p + j, sizeof(S));
+	return v;
+}
+
+template <typename S, typename T>
+static KERNEL_INLINE void store(T *p, long j, const S &v) {
+	memcpy(p + j, &v, sizeof(S));
+}
+
+/*
+ * Operand of the operations. The 8 and 16-bit integers would promote to signed int and overflow,
+ * so they are widened to unsigned int instead and wrap like the wider integers.
+ */
+template <typename S> static KERNEL_INLINE const S &widen(const S &v) { return v; }
+static KERNEL_INLINE unsigned int widen(unsigned short v) { return v; }
+static KERNEL_INLINE unsigned int widen(unsigned char v) { return v; }
+
+/*
+ * GCC vector of T, Bytes wide.
+ */
+template <typename T, int Bytes>
+struct vector_t {
+	typedef T type __attribute__((vector_size(Bytes)));
+};
+
+/*
+ * Fused multiply-add r = a * b + c with a single rounding, for every floating point type and vector width.
+ * The vectors are passed by reference, as passing or returning them by value in a function compiled
+ * without AVX changes the ABI.
+ * These use the ia32 builtins declared by immintrin.h rather than the intrinsics, because the builtins
+ * are expanded after inlining into the kernels compiled for an FMA target, while the intrinsics would
+ * need one here.
+ */
+static KERNEL_INLINE void fused_madd(double &r, double a, double b, double c) { r = __builtin_fma(a, b, c); }
+static KERNEL_INLINE void fused_madd(float &r, float a, float b, float c) { r = __builtin_fmaf(a, b, c); }
+static KERNEL_INLINE void fused_madd(vector_t<double, 16>::type &r, const vector_t<double, 16>::type &a, const vector_t<double, 16>::type &b, const vector_t<double, 16>::type &c) { r = __builtin_ia32_vfmaddpd(a, b, c); }
+static KERNEL_INLINE void fused_madd(vector_t<float, 16>::type &r, const vector_t<float, 16>::type &a, const vector_t<float, 16>::type &b, const vector_t<float, 16>::type &c) { r = __builtin_ia32_vfmaddps(a, b, c); }
+static KERNEL_INLINE void fused_madd(vector_t<double, 32>::type &r, const vector_t<double, 32>::type &a, const vector_t<double, 32>::type &b, const vector_t<double, 32>::type &c) { r = __builtin_ia32_vfmaddpd256(a, b, c); }
+static KERNEL_INLINE void fused_madd(vector_t<float, 32>::type &r, const vector_t<float, 32>::type &a, const vector_t<float, 32>::type &b, const vector_t<float, 32>::type &c) { r = __builtin_ia32_vfmaddps256(a, b, c); }
+static KERNEL_INLINE void fused_madd(vector_t<double, 64>::type &r, const vector_t<double, 64>::type &a, const vector_t<double, 64>::type &b, const vector_t<double, 64>::type &c) { r = __builtin_ia32_vfmaddpd512_mask(a, b, c, -1, 4); }
+static KERNEL_INLINE void fused_madd(vector_t<float, 64>::type &r, const vector_t<float, 64>::type &a, const vector_t<float, 64>::type &b, const vector_t<float, 64>::type &c) { r = __builtin_ia32_vfmaddps512_mask(a, b, c, -1, 4); }
+
+/*
+ * Operations. Each one corresponds to the ADD_1 macro of the C benchmarks with the same name.
+ * Operations with a fused counterpart count their floating point operations per element, and
+ * the fused one computes the multiply and the add next to it with a single FMA.
+ */
+struct op_add {
+	static const char *name() { return "add"; }
+	static const int num_arrays = 1;
+	static const bool integer_only = false;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { sum += widen(load<S>(x.a, j)); }
+};
+
+struct op_addmul {
+	static const char *name() { return "addmul"; }
+	static const int num_arrays = 2;
+	static const bool integer_only = false;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { sum += widen(load<S>(x.a, j)) * (17 + widen(load<S>(x.b, j))); }
+};
+
+struct op_scale {
+	static const char *name() { return "scale"; }
+	static const int num_arrays = 1;
+	static const bool integer_only = false;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { sum += x.scalar * widen(load<S>(x.a, j)); }
+};
+
+struct op_triad_fma {
+	static const char *name() { return "triad"; }
+	static const int num_arrays = 2;
+	static const bool integer_only = false;
+	static const int flops = 3;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { S t; fused_madd(t, S() + x.scalar, load<S>(x.b, j), load<S>(x.a, j)); sum += t; }
+};
+
+struct op_triad {
+	static const char *name() { return "triad"; }
+	static const int num_arrays = 2;
+	static const bool integer_only = false;
+	static const int flops = 3;
+	typedef op_triad_fma fused;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { sum += widen(load<S>(x.a, j)) + x.scalar * widen(load<S>(x.b, j)); }
+};
+
+struct op_schoenauer_fma {
+	static const char *name() { return "schoenauer"; }
+	static const int num_arrays = 3;
+	static const bool integer_only = false;
+	static const int flops = 3;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { S t; fused_madd(t, load<S>(x.b, j), load<S>(x.c, j), load<S>(x.a, j)); sum += t; }
+};
+
+struct op_schoenauer {
+	static const char *name() { return "schoenauer"; }
+	static const int num_arrays = 3;
+	static const bool integer_only = false;
+	static const int flops = 3;
+	typedef op_schoenauer_fma fused;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { sum += widen(load<S>(x.a, j)) + widen(load<S>(x.b, j)) * widen(load<S>(x.c, j)); }
+};
+
+struct op_schoenauer_mwrite {
+	static const char *name() { return "schoenauer-mwrite"; }
+	static const int num_arrays = 4;
+	static const bool integer_only = false;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { (void)sum; store(x.d, j, S(widen(load<S>(x.d, j)) + (widen(load<S>(x.a, j)) + widen(load<S>(x.b, j)) * widen(load<S>(x.c, j))))); }
+};
+
+struct op_addmulshift {
+	static const char *name() { return "addmulshift"; }
+	static const int num_arrays = 2;
+	static const bool integer_only = true;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { sum += widen(load<S>(x.a, j)) * widen(load<S>(x.b, j)) << 2; }
+};
+
+struct op_addmulshift2 {
+	static const char *name() { return "addmulshift2"; }
+	static const int num_arrays = 2;
+	static const bool integer_only = true;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { sum += widen(load<S>(x.a, j)) * (widen(load<S>(x.b, j)) + 1) << 2; }
+};
+
+struct op_addmulshift3 {
+	static const char *name() { return "addmulshift3"; }
+	static const int num_arrays = 2;
+	static const bool integer_only = true;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { sum += ((widen(load<S>(x.a, j)) << 3) + 1) * ((widen(load<S>(x.b, j)) << 2) + 1); }
+};
+
+struct op_addmulshift4 {
+	static const char *name() { return "addmulshift4"; }
+	static const int num_arrays = 2;
+	static const bool integer_only = true;
+	template <typename S, typename T> static KERNEL_INLINE void apply(S &sum, arrays_t<T> &x, long j) { sum += (widen(load<S>(x.a, j)) << 3) * (widen(load<S>(x.a, j)) << 4) * ((widen(load<S>(x.b, j)) << 2) * 5 + 1); }
+};
+
+/*
+ * Working set sizes, in bytes for all arrays together.
+ */
+struct level_l1 {
+	static const char *name() { return "l1"; }
+	static const long bytes = 24 * 1024;
+};
+
+struct level_l2 {
+	static const char *name() { return "l2"; }
+	static const long bytes = 192 * 1024;
+};
+
+struct level_l3 {
+	static const char *name() { return "l3"; }
+	static const long bytes = 1536 * 1024;
+};
+
+/*
+ * Compile-time recursive expansion, equivalent to the exponential ADD_1 .. ADD_2048 macros.
+ * Element K of the expansion adds into sum[K % Acc], so Acc independent dependency chains
+ * run in parallel. With a vector accumulator every element of the expansion covers all its lanes.
+ */
+template <int N, int Acc = 1, int K = 0>
+struct unroll {
+	template <typename Op, typename S, typename T>
+	static KERNEL_INLINE void run(S *sum, arrays_t<T> &x, long &j) {
+		unroll<N / 2, Acc, K>::template run<Op>(sum, x, j);
+		unroll<N - N / 2, Acc, (K + N / 2) % Acc>::template run<Op>(sum, x, j);
+	}
+};
+
+template <int Acc, int K>
+struct unroll<1, Acc, K> {
+	template <typename Op, typename S, typename T>
+	static KERNEL_INLINE void run(S *sum, arrays_t<T> &x, long &j) {
+		Op::apply(sum[K], x, j);
+		j += sizeof(S) / sizeof(T);
+	}
+};
+
+/*
+ * Benchmark kernel
+ */
+template <typename T, typename Op, long Length, int Unroll>
+__attribute__((noinline)) T kernel(long ntimes, arrays_t<T> x) {
+	long i = 0, j = 0;
+	T sum = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < Length;) {
+			unroll<Unroll>::template run<Op>(&sum, x, j);
+		}
+	}
+	return sum;
+}
+
+/*
+ * One cell of the matrix. The normal version uses the given unroll count and the extreme version twice that.
+ */
+template <typename T, typename Op, typename Level, int Unroll>
+struct cell {
+	/* Elements per array, rounded down to a multiple of the extreme unroll count */
+	static const long length = Level::bytes / (Op::num_arrays * (long)sizeof(T)) / (2 * Unroll) * (2 * Unroll);
+	static_assert(length >= 2 * Unroll, "Working set too small for the unroll count");
+
+	static int init(void **benchdata) {
+		arrays_t<T> *data = (arrays_t<T> *)calloc(1, sizeof(arrays_t<T>));
+		*benchdata = data;
+		T *a = NULL;
+
+		/* Allocate memory for the data arrays */
+		data->a = a = (T *)measure_aligned_alloc(Op::num_arrays * length * sizeof(T), array_alignment);
+		data->b = Op::num_arrays > 1 ? data->a + length : NULL;
+		data->c = Op::num_arrays > 2 ? data->b + length : NULL;
+		data->d = Op::num_arrays > 3 ? data->c + length : NULL;
+		data->scalar = 3;
+
+		/* Fill with the data pattern selected with -d */
+		if (type_traits<T>::is_integer) {
+			measure_fill_int_array(a, Op::num_arrays * length, sizeof(T));
+		} else {
+			measure_fill_float_array(a, Op::num_arrays * length, sizeof(T));
+		}
+
+		/* Success */
+		return 1;
+	}
+
+	static int normal(void *benchdata, long ntimes) {
+		return kernel<T, Op, length, Unroll>(ntimes, *(arrays_t<T> *)benchdata);
+	}
+
+	static int extreme(void *benchdata, long ntimes) {
+		return kernel<T, Op, length, 2 * Unroll>(ntimes, *(arrays_t<T> *)benchdata);
+	}
+
+	static int cleanup(void *benchdata) {
+		arrays_t<T> *data = (arrays_t<T> *)benchdata;
+		free(data->a);
+		free(data);
+
+		/* Success */
+		return 1;
+	}
+
+	static void register_benchmark() {
+		measure_benchmark_t *bench = (measure_benchmark_t *)measure_alloc(sizeof(*bench));
+		char name[256];
+
+		snprintf(name, sizeof(name), "matrix-%s-array-%s-%s-u%d", type_traits<T>::name(), Level::name(), Op::name(), Unroll);
+		bench->name = strdup(name);
+		bench->init = init;
+		bench->normal = normal;
+		bench->extreme = extreme;
+		bench->cleanup = cleanup;
+		bench->ntimes = elements_per_sample / length;
+		measure_register_benchmark(bench);
+	}
+};
+
+/*
+ * Benchmark kernel with the array length chosen at runtime, used for working set sweeps.
+ * The partial sums of the Acc accumulators are combined at the end.
+ */
+template <typename T, typename Op, int Unroll, int Acc>
+__attribute__((noinline)) T kernel_sweep(long ntimes, arrays_t<T> x, long length) {
+	long i = 0, j = 0;
+	T sum[Acc] = {};
+	T total = 0;
+	int k = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < length;) {
+			unroll<Unroll, Acc>::template run<Op>(sum, x, j);
+		}
+	}
+	for (k = 0; k < Acc; k++) {
+		total += sum[k];
+	}
+	return total;
+}
+
+/*
+ * Select the kernel for the number of accumulators given with -A.
+ */
+template <typename T, typename Op, int Unroll>
+static T kernel_sweep_dispatch(long ntimes, arrays_t<T> x, long length) {
+	switch (arg_num_accumulators) {
+	case 2: return kernel_sweep<T, Op, Unroll, 2>(ntimes, x, length);
+	case 4: return kernel_sweep<T, Op, Unroll, 4>(ntimes, x, length);
+	case 8: return kernel_sweep<T, Op, Unroll, 8>(ntimes, x, length);
+	case 16: return kernel_sweep<T, Op, Unroll, 16>(ntimes, x, length);
+	default: return kernel_sweep<T, Op, Unroll, 1>(ntimes, x, length);
+	}
+}
+
+/*
+ * Vector kernels. The body is the same unrolled expansion as in the scalar kernels with every
+ * element replaced by a vector S, and the lanes of the vector accumulator are combined at the end.
+ * Each width is compiled for its own target: SSE4.1 for pmulld, and AVX-512 with the byte, word
+ * and quadword instructions (vpmullw, vpmullq) so that every integer width has native multiplies
+ * except bytes.
+ */
+template <typename T, typename Op, int Unroll, typename S>
+static KERNEL_INLINE T kernel_vector_body(long ntimes, arrays_t<T> &x, long length) {
+	long i = 0, j = 0;
+	S sum = S();
+	T lanes[sizeof(S) / sizeof(T)];
+	T total = 0;
+	int k = 0;
+	for (i = 0; i < ntimes; i++) {
+		for (j = 0; j < length;) {
+			unroll<Unroll>::template run<Op>(&sum, x, j);
+		}
+	}
+	memcpy(lanes, &sum, sizeof(S));
+	for (k = 0; k < (int)(sizeof(S) / sizeof(T)); k++) {
+		total += lanes[k];
+	}
+	return total;
+}
+
+template <typename T, typename Op, int Unroll>
+__attribute__((noinline, target("sse4.1"))) T kernel_sse(long ntimes, arrays_t<T> x, long length) {
+	return kernel_vector_body<T, Op, Unroll, typename vector_t<T, 16>::type>(ntimes, x, length);
+}
+
+template <typename T, typename Op, int Unroll>
+__attribute__((noinline, target("avx2"))) T kernel_avx2(long ntimes, arrays_t<T> x, long length) {
+	return kernel_vector_body<T, Op, Unroll, typename vector_t<T, 32>::type>(ntimes, x, length);
+}
+
+template <typename T, typename Op, int Unroll>
+__attribute__((noinline, target("avx512f,avx512bw,avx512dq"))) T kernel_avx512(long ntimes, arrays_t<T> x, long length) {
+	return kernel_vector_body<T, Op, Unroll, typename vector_t<T, 64>::type>(ntimes, x, length);
+}
+
+/*
+ * Select the kernel for the vector width detected with CPUID or given with -V.
+ */
+template <typename T, typename Op, int Unroll>
+static T kernel_vector_dispatch(long ntimes, arrays_t<T> x, long length) {
+	switch (measure_vector_width()) {
+	case 512: return kernel_avx512<T, Op, Unroll>(ntimes, x, length);
+	case 256: return kernel_avx2<T, Op, Unroll>(ntimes, x, length);
+	default: return kernel_sse<T, Op, Unroll>(ntimes, x, length);
+	}
+}
+
+/*
+ * FMA pair kernels. Both versions of a pair are compiled for a target with FMA, so they differ only
+ * in whether the multiply and the add are fused. The 128-bit kernels therefore use the VEX encoding.
+ */
+template <typename T, typename Op, int Unroll>
+__attribute__((noinline, target("fma"))) T kernel_fma_scalar(long ntimes, arrays_t<T> x, long length) {
+	return kernel_vector_body<T, Op, Unroll, T>(ntimes, x, length);
+}
+
+template <typename T, typename Op, int Unroll>
+__attribute__((noinline, target("fma"))) T kernel_fma_sse(long ntimes, arrays_t<T> x, long length) {
+	return kernel_vector_body<T, Op, Unroll, typename vector_t<T, 16>::type>(ntimes, x, length);
+}
+
+template <typename T, typename Op, int Unroll>
+__attribute__((noinline, target("avx2,fma"))) T kernel_fma_avx2(long ntimes, arrays_t<T> x, long length) {
+	return kernel_vector_body<T, Op, Unroll, typename vector_t<T, 32>::type>(ntimes, x, length);
+}
+
+template <typename T, typename Op, int Unroll>
+static T kernel_fma_dispatch(long ntimes, arrays_t<T> x, long length) {
+	switch (measure_vector_width()) {
+	case 512: return kernel_avx512<T, Op, Unroll>(ntimes, x, length);
+	case 256: return kernel_fma_avx2<T, Op, Unroll>(ntimes, x, length);
+	default: return kernel_fma_sse<T, Op, Unroll>(ntimes, x, length);
+	}
+}
+
+/*
+ * Kernels of a sweep cell:
+ *   KERNEL_SCALAR      scalar with the accumulators selected by -A, the extreme version unrolls twice as much
+ *   KERNEL_VECTOR      vector with the width selected by -V, the extreme version unrolls twice as much
+ *   KERNEL_FMA         scalar, the normal version is unfused and the extreme version fused
+ *   KERNEL_FMA_VECTOR  the same with the width selected by -V
+ * Lanes is the largest number of elements processed by one instruction, and ops_per_element the
+ * floating point operations counted for the energy per operation columns. The FMA kernels are
+ * compiled for an FMA target at every width, so their cells need a CPU with FMA.
+ */
+enum { KERNEL_SCALAR, KERNEL_VECTOR, KERNEL_FMA, KERNEL_FMA_VECTOR };
+
+template <typename T, typename Op, int Unroll, int Kind>
+struct sweep_kernel;
+
+template <typename T, typename Op, int Unroll>
+struct sweep_kernel<T, Op, Unroll, KERNEL_SCALAR> {
+	static const char *prefix() { return "sweep"; }
+	static const bool needs_fma = false;
+	static const long lanes = 1;
+	static const int ops_per_element = 0;
+	static T normal(long ntimes, arrays_t<T> x, long length) {
+		return kernel_sweep_dispatch<T, Op, Unroll>(ntimes, x, length);
+	}
+	static T extreme(long ntimes, arrays_t<T> x, long length) {
+		return kernel_sweep_dispatch<T, Op, 2 * Unroll>(ntimes, x, length);
+	}
+};
+
+template <typename T, typename Op, int Unroll>
+struct sweep_kernel<T, Op, Unroll, KERNEL_VECTOR> {
+	static const char *prefix() { return "vector"; }
+	static const bool needs_fma = false;
+	static const long lanes = 64 / sizeof(T);
+	static const int ops_per_element = 0;
+	static T normal(long ntimes, arrays_t<T> x, long length) {
+		return kernel_vector_dispatch<T, Op, Unroll>(ntimes, x, length);
+	}
+	static T extreme(long ntimes, arrays_t<T> x, long length) {
+		return kernel_vector_dispatch<T, Op, 2 * Unroll>(ntimes, x, length);
+	}
+};
+
+template <typename T, typename Op, int Unroll>
+struct sweep_kernel<T, Op, Unroll, KERNEL_FMA> {
+	static const char *prefix() { return "fma"; }
+	static const bool needs_fma = true;
+	static const long lanes = 1;
+	static const int ops_per_element = Op::flops;
+	static T normal(long ntimes, arrays_t<T> x, long length) {
+		return kernel_fma_scalar<T, Op, Unroll>(ntimes, x, length);
+	}
+	static T extreme(long ntimes, arrays_t<T> x, long length) {
+		return kernel_fma_scalar<T, typename Op::fused, Unroll>(ntimes, x, length);
+	}
+};
+
+template <typename T, typename Op, int Unroll>
+struct sweep_kernel<T, Op, Unroll, KERNEL_FMA_VECTOR> {
+	static const char *prefix() { return "fma-vector"; }
+	static const bool needs_fma = true;
+	static const long lanes = 64 / sizeof(T);
+	static const int ops_per_element = Op::flops;
+	static T normal(long ntimes, arrays_t<T> x, long length) {
+		return kernel_fma_dispatch<T, Op, Unroll>(ntimes, x, length);
+	}
+	static T extreme(long ntimes, arrays_t<T> x, long length) {
+		return kernel_fma_dispatch<T, typename Op::fused, Unroll>(ntimes, x, length);
+	}
+};
+
+/*
+ * Working set sweep over one operation. The unrolled body is the same as in the l1/l2/l3 cells,
+ * only the array length is set at runtime with -s and the number of accumulators with -A.
+ * The vector cells unroll the same number of vector instructions instead.
+ */
+template <typename T, typename Op, int Unroll, int Kind = KERNEL_SCALAR>
+struct sweep_cell {
+	typedef sweep_kernel<T, Op, Unroll, Kind> kernels;
+
+	struct data_t {
+		arrays_t<T> x;
+		long length;
+	};
+
+	/* Elements processed by the extreme version in one pass over the unrolled body */
+	static const long granule = 2 * Unroll * kernels::lanes;
+
+	/* Elements per array, rounded down to a multiple of the extreme unroll count */
+	static long length_for(long bytes) {
+		long length = bytes / (Op::num_arrays * (long)sizeof(T)) / granule * granule;
+		return length >= granule ? length : granule;
+	}
+
+	static long set_param(void *benchdata, long bytes) {
+		data_t *data = (data_t *)benchdata;
+		long length = length_for(bytes);
+		T *a = NULL;
+
+		/* Reallocate memory for the data arrays */
+		free(data->x.a);
+		data->x.a = a = (T *)measure_aligned_alloc(Op::num_arrays * length * sizeof(T), array_alignment);
+		data->x.b = Op::num_arrays > 1 ? data->x.a + length : NULL;
+		data->x.c = Op::num_arrays > 2 ? data->x.b + length : NULL;
+		data->x.d = Op::num_arrays > 3 ? data->x.c + length : NULL;
+		data->x.scalar = 3;
+		data->length = length;
+
+		/* Fill with the data pattern selected with -d */
+		if (type_traits<T>::is_integer) {
+			measure_fill_int_array(a, Op::num_arrays * length, sizeof(T));
+		} else {
+			measure_fill_float_array(a, Op::num_arrays * length, sizeof(T));
+		}
+
+		/* Effective working set in bytes */
+		return Op::num_arrays * length * (long)sizeof(T);
+	}
+
+	/* The fma-* cells are skipped on CPUs without FMA */
+	static const char *missing_feature() {
+		if (kernels::needs_fma && !__builtin_cpu_supports("fma")) {
+			return "FMA";
+		}
+		return NULL;
+	}
+
+	static int init(void **benchdata) {
+		data_t *data = (data_t *)calloc(1, sizeof(data_t));
+		*benchdata = data;
+		return set_param(data, level_l1::bytes) > 0;
+	}
+
+	static int normal(void *benchdata, long ntimes) {
+		data_t *data = (data_t *)benchdata;
+		return kernels::normal(ntimes, data->x, data->length);
+	}
+
+	static int extreme(void *benchdata, long ntimes) {
+		data_t *data = (data_t *)benchdata;
+		return kernels::extreme(ntimes, data->x, data->length);
+	}
+
+	static int cleanup(void *benchdata) {
+		data_t *data = (data_t *)benchdata;
+		free(data->x.a);
+		free(data);
+
+		/* Success */
+		return 1;
+	}
+
+	static void register_benchmark() {
+		measure_benchmark_t *bench = (measure_benchmark_t *)measure_alloc(sizeof(*bench));
+		char name[256];
+
+		snprintf(name, sizeof(name), "%s-%s-array-%s", kernels::prefix(), type_traits<T>::name(), Op::name());
+		bench->name = strdup(name);
+		bench->init = init;
+		bench->normal = normal;
+		bench->extreme = extreme;
+		bench->cleanup = cleanup;
+		/* The vector kernels are tuned for the 128-bit width, the wider ones finish sooner */
+		bench->ntimes = elements_per_sample / length_for(level_l1::bytes) * (kernels::lanes > 1 ? 16 / (long)sizeof(T) : 1);
+		bench->set_param = set_param;
+		bench->param_name = "working_set_bytes";
+		bench->param_default = Op::num_arrays * length_for(level_l1::bytes) * (long)sizeof(T);
+		bench->max_accumulators = Kind == KERNEL_SCALAR ? 16 : 0;
+		bench->vectorized = kernels::lanes > 1;
+		bench->ops_per_iteration = kernels::ops_per_element * length_for(level_l1::bytes);
+		bench->missing_feature = missing_feature;
+		measure_register_benchmark(bench);
+	}
+};
+
+/*
+ * Registration of the cross product. Integer-only operations are skipped for floating point types.
+ */
+template <typename T, typename Op, typename Level, bool Enabled = !Op::integer_only || type_traits<T>::is_integer>
+struct register_unrolls {
+	static void run() {
+		cell<T, Op, Level, 64>::register_benchmark();
+		cell<T, Op, Level, 128>::register_benchmark();
+	}
+};
+
+template <typename T, typename Op, typename Level>
+struct register_unrolls<T, Op, Level, false> {
+	static void run() {}
+};
+
+template <typename T, typename Op, bool Enabled = !Op::integer_only || type_traits<T>::is_integer>
+struct register_vector {
+	static void run() {
+		sweep_cell<T, Op, 64, KERNEL_VECTOR>::register_benchmark();
+	}
+};
+
+template <typename T, typename Op>
+struct register_vector<T, Op, false> {
+	static void run() {}
+};
+
+/*
+ * The addmulshift family as scalar sweeps and at every vector width, for the integer types only.
+ */
+template <typename T, bool Enabled = type_traits<T>::is_integer>
+struct register_addmulshift {
+	static void run() {
+		sweep_cell<T, op_addmulshift, 64>::register_benchmark();
+		sweep_cell<T, op_addmulshift2, 64>::register_benchmark();
+		sweep_cell<T, op_addmulshift3, 64>::register_benchmark();
+		sweep_cell<T, op_addmulshift4, 64>::register_benchmark();
+		register_vector<T, op_addmulshift>::run();
+		register_vector<T, op_addmulshift2>::run();
+		register_vector<T, op_addmulshift3>::run();
+		register_vector<T, op_addmulshift4>::run();
+	}
+};
+
+template <typename T>
+struct register_addmulshift<T, false> {
+	static void run() {}
+};
+
+/*
+ * FMA pairs exist for the floating point types only.
+ */
+template <typename T, typename Op, bool Enabled = !type_traits<T>::is_integer>
+struct register_fma {
+	static void run() {
+		sweep_cell<T, Op, 64, KERNEL_FMA>::register_benchmark();
+		sweep_cell<T, Op, 64, KERNEL_FMA_VECTOR>::register_benchmark();
+	}
+};
+
+template <typename T, typename Op>
+struct register_fma<T, Op, false> {
+	static void run() {}
+};
+
+template <typename T, typename Op>
+static void register_levels() {
+	register_unrolls<T, Op, level_l1>::run();
+	register_unrolls<T, Op, level_l2>::run();
+	register_unrolls<T, Op, level_l3>::run();
+}
+
+template <typename T>
+static void register_type() {
+	register_levels<T, op_add>();
+	register_levels<T, op_addmul>();
+	register_levels<T, op_scale>();
+	register_levels<T, op_triad>();
+	register_levels<T, op_schoenauer>();
+	register_levels<T, op_schoenauer_mwrite>();
+	register_levels<T, op_addmulshift>();
+	register_levels<T, op_addmulshift2>();
+	register_levels<T, op_addmulshift3>();
+	register_levels<T, op_addmulshift4>();
+
+	/* Working set sweeps */
+	sweep_cell<T, op_schoenauer, 64>::register_benchmark();
+	sweep_cell<T, op_triad, 64>::register_benchmark();
+	sweep_cell<T, op_scale, 64>::register_benchmark();
+	sweep_cell<T, op_add, 64>::register_benchmark();
+	sweep_cell<T, op_addmul, 64>::register_benchmark();
+
+	/* Vector kernels, the width is selected at runtime */
+	register_vector<T, op_add>::run();
+	register_vector<T, op_addmul>::run();
+	register_vector<T, op_scale>::run();
+	register_vector<T, op_triad>::run();
+	register_vector<T, op_schoenauer>::run();
+
+	/* Integer multiply and shift, scalar and vector */
+	register_addmulshift<T>::run();
+
+	/* Unfused and fused multiply-add pairs */
+	register_fma<T, op_triad>::run();
+	register_fma<T, op_schoenauer>::run();
+}
+
+/*
+ * Registers every cell of the matrix for one data type at program startup.
+ */
+template <typename T>
+struct registrar {
+	registrar() {
+		register_type<T>();
+	}
+};
+
+/*
+ * Registers only the integer SIMD cells, for the 8-bit and 16-bit types which have no C benchmarks.
+ */
+template <typename T>
+struct simd_registrar {
+	simd_registrar() {
+		register_addmulshift<T>::run();
+	}
+};
+
+} /* namespace kernel_matrix */
+
+#pragma GCC diagnostic pop
+
+#endif /* KERNEL_MATRIX_HPP */
@@ -44,7 +44,10 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <xmmintrin.h>
 
 #include <papi.h>
 
@@ -101,6 +104,14 @@ int perf_event_2_code = -1;
 int perf_event_3_code = -1;
 int perf_event_4_code = -1;
 
+/*
+ * Default events, benchmarks and the -e option may replace them.
+ */
+static const char **perf_event_names[4] = { &perf_event_1_name, &perf_event_2_name, &perf_event_3_name, &perf_event_4_name };
+static const char **perf_event_pretty_names[4] = { &perf_event_1_pretty_name, &perf_event_2_pretty_name, &perf_event_3_pretty_name, &perf_event_4_pretty_name };
+static const char *perf_event_default_names[4] = { "UOPS_ISSUED:ANY", "IDQ:MITE_UOPS", "IDQ:DSB_UOPS", "IDQ:MS_UOPS" };
+static const char *perf_event_default_pretty_names[4] = { "Uops issued:", "MITE uops:", "DSB uops:", "MS uops:" };
+
 /*
  * Some PAPI functions don't seem to be thread safe...
  */
@@ -171,13 +182,41 @@ static double read_voltage(int fd) {
 	}
 }
 
+/*
+ * Look up the codes of the selected programmable events. An event which is not found keeps the
+ * code -1, so that adding it fails instead of counting the event of a previous benchmark.
+ */
+static int measure_resolve_perf_events(void) {
+	int slot = 0, code = 0;
+	int *codes[4] = { &perf_event_1_code, &perf_event_2_code, &perf_event_3_code, &perf_event_4_code };
+
+	for (slot = 0; slot < 4; slot++) {
+		char *name = strdup(*perf_event_names[slot]);
+		*codes[slot] = -1;
+		if (PAPI_event_name_to_code(name, &code) == PAPI_OK) {
+			*codes[slot] = code;
+		} else {
+			fprintf(stderr, "Warning: No such event found \"%s\"!\n", name);
+		}
+		free(name);
+	}
+	return 1;
+}
+
 /*
  * Initialize the measurement framework. This needs to be executed before any threads are spawned.
  */
 int measure_init_papi(int flags) {
 	/* Ignore flags */
 	(void)flags;
-	int code = 0;
+	static char papi_initialized = 0;
+
+	/* Running multiple benchmarks in the same process only needs one initialization,
+	 * but every benchmark may select different events */
+	if (papi_initialized) {
+		return measure_resolve_perf_events();
+	}
+	papi_initialized = 1;
 
 	/* NOTE: PAPI_library_init gets stuck if called by multiple threads! */
 	if (PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT) {
@@ -192,34 +231,7 @@ int measure_init_papi(int flags) {
 	}
 
 	/* Cache event codes for faster performance. */
-	char *name = strdup(perf_event_1_name);
-	if (PAPI_event_name_to_code(name, &code) == PAPI_OK) {
-		perf_event_1_code = code;
-	} else {
-		fprintf(stderr, "Warning: No such event found \"%s\"!\n", name);
-	}
-	free(name);
-	name = strdup(perf_event_2_name);
-	if (PAPI_event_name_to_code(name, &code) == PAPI_OK) {
-		perf_event_2_code = code;
-	} else {
-		fprintf(stderr, "Warning: No such event found \"%s\"!\n", name);
-	}
-	free(name);
-	name = strdup(perf_event_3_name);
-	if (PAPI_event_name_to_code(name, &code) == PAPI_OK) {
-		perf_event_3_code = code;
-	} else {
-		fprintf(stderr, "Warning: No such event found \"%s\"!\n", name);
-	}
-	free(name);
-	name = strdup(perf_event_4_name);
-	if (PAPI_event_name_to_code(name, &code) == PAPI_OK) {
-		perf_event_4_code = code;
-	} else {
-		fprintf(stderr, "Warning: No such event found \"%s\"!\n", name);
-	}
-	free(name);
+	measure_resolve_perf_events();
 
 	/* Initialize the mutex used to protect some calls to PAPI functions */
 	pthread_mutex_init(&papi_mutex, NULL);
@@ -576,6 +588,28 @@ int measure_stop(measure_state_t *state, int flags) {
 	return 1;
 }
 
+/*
+ * Read the current package temperature. Returns a negative value if the temperature is not available.
+ */
+double measure_read_pkg_temp(void) {
+	if (core0_fd < 0) {
+		return -1;
+	}
+	return read_temp(core0_fd, MSR_IA32_PACKAGE_THERM_STATUS);
+}
+
+/*
+ * MSR access for benchmarks which sample MSRs themselves, e.g. at phase boundaries within a run.
+ * measure_open_msr returns a negative value and measure_read_msr returns 0 on failure.
+ */
+int measure_open_msr(int core) {
+	return open_msr(core);
+}
+
+int measure_read_msr(int fd, unsigned msr_offset, uint64_t *value) {
+	return read_msr(fd, msr_offset, value);
+}
+
 /*
  * Function for combining result sets from different threads.
  */
@@ -826,6 +860,8 @@ typedef struct {
 	long ntimes;
 	measure_state_t measure_state;
 	char do_measure;
+	long (*set_param)(void *benchdata, long value);
+	long param;
 } thread_args_t;
 
 
@@ -841,11 +877,24 @@ static void *measure_benchmark_init_thread(void *arg) {
 	return NULL;
 }
 
+/*
+ * Parameter thread function. Runs in the worker so that reallocated memory is first touched by the right thread.
+ */
+static void *measure_benchmark_param_thread(void *arg) {
+	thread_args_t *args = (thread_args_t *) arg;
+	args->param = args->set_param(args->benchdata, args->param);
+	return NULL;
+}
+
 /*
  * Worker thread function
  */
 static void *measure_benchmark_thread(void *arg) {
 	thread_args_t *args = (thread_args_t *) arg;
+	/* Flush-to-zero and denormals-are-zero modes selected with -Z */
+	if (arg_mxcsr_bits) {
+		_mm_setcsr(_mm_getcsr() | arg_mxcsr_bits);
+	}
 	if (args->do_measure) {
 		measure_init_thread(&args->measure_state, MEASURE_FLAG_NO_ENERGY);
 		measure_start(&args->measure_state, 0);
@@ -936,274 +985,1358 @@ static void phase_warmup(measure_benchmark_t *bench, char quiet_mode, int (*warm
 }
 
 /*
- * Parsed command line parameters
+ * Results of a single measured repetition.
  */
-char arg_do_measure        = 0;
-char arg_use_64bit_numbers = 0;
-int  arg_benchmark_phase   = -1;
-int  arg_num_threads       = 1;
-int  arg_num_repeat        = 1;
-int  arg_multiplier        = 1;
-int  arg_warmup_time       = 120; /* 2 minutes */
-char arg_force_affinity    = 0;
+typedef struct {
+	double time_elapsed;
+	double uops_issued;
+	double idq_mite_uops;
+	double idq_dsb_uops;
+	double idq_ms_uops;
+	double pkg_power;
+	double pp0_power;
+	double pkg_dyn_power;
+	double pp0_dyn_power;
+	double pkg_power_tnorm;
+	double pp0_power_tnorm;
+	double pkg_temp;
+	double pkg_temp_avg;
+} measure_sample_t;
 
-int measure_main(int argc, char **argv, measure_benchmark_t *bench) {
-	long i = 0, j = 0;
-	thread_args_t *targs = NULL;
-	void *thread_result = NULL;
-	int measure_flags = 0;
+/*
+ * Idle power and harness overhead measured during the calibration phase.
+ */
+typedef struct {
+	double idle_pkg_power;
+	double idle_pp0_power;
+	double overhead_time;
+	double overhead_pkg_energy;
+	double overhead_pp0_energy;
+} measure_baseline_t;
+
+static measure_baseline_t measure_baseline;
+
+/*
+ * Linear leakage model (power = intercept + slope * temperature) fitted during the calibration phase.
+ */
+typedef struct {
+	double pkg_slope;
+	double pkg_intercept;
+	double pp0_slope;
+	double pp0_intercept;
+	int num_points;
+} measure_leakage_t;
+
+static measure_leakage_t measure_leakage;
+
+/*
+ * Run the benchmark once in every thread without starting or stopping the main measurement.
+ */
+static void phase_run_threads(int (*func)(void *, long), long ntimes, thread_args_t *targs, pthread_attr_t *attrp) {
+	long i = 0;
 	int rval = 0;
-	measure_state_t measure_state;
-	char quiet_mode = 0;
-	memset(&measure_state, 0, sizeof(measure_state));
-	pthread_attr_t attr, *attrp = NULL;
-	pthread_attr_init(&attr);
+	void *thread_result = NULL;
 
-	/* Process command line arguments */
-	for (i = 1; i < argc; i++) {
-		if (strcmp(argv[i], "-a") == 0) {
-			/* Force the CPU affinity of benchmark threads */
-			arg_force_affinity = 1;
-		}
-		else if (strcmp(argv[i], "-b") == 0) {
-			/* Use either 64-bit integers or double-precision floating point */
-			arg_use_64bit_numbers = 1;
-		}
-		else if (strcmp(argv[i], "-m") == 0) {
-			/* Measure timing, performance and power consumption */
-			arg_do_measure = 1;
-		}
-		else if (strcmp(argv[i], "-n") == 0) {
-			/* Multiply the running time of micro benchmarks by a given factor */
-			if (i + 1 < argc) {
-				i++;
-				arg_multiplier = atoi(argv[i]);
-				bench->ntimes *= arg_multiplier;
-			}
-		}
-		else if (strcmp(argv[i], "-p") == 0) {
-			/* Only execute a specific benchmark phase (warmup = 0, normal = 1, or extreme = 2) */
-			if (i + 1 < argc) {
-				i++;
-				arg_benchmark_phase = atoi(argv[i]);
-			}
-		}
-		else if (strcmp(argv[i], "-r") == 0) {
-			/* Number of times to repeat */
-			if (i + 1 < argc) {
-				i++;
-				arg_num_repeat = atoi(argv[i]);
-			}
-		}
-		else if (strcmp(argv[i], "-t") == 0) {
-			/* Number of threads */
-			if (i + 1 < argc) {
-				i++;
-				arg_num_threads = atoi(argv[i]);
-			}
-		}
-		else if (strcmp(argv[i], "-w") == 0) {
-			/* Warmup time in seconds */
-			if (i + 1 < argc) {
-				i++;
-				arg_warmup_time = atoi(argv[i]);
-			}
-		}
-		else {
-			fprintf(stderr, "Error: Unrecognized option \"%s\".\n", argv[i]);
+	for (i = 0; i < arg_num_threads; i++) {
+		targs[i].benchmark = func;
+		targs[i].ntimes = ntimes;
+		measure_set_thread_affinity(attrp, i);
+		rval = pthread_create(&targs[i].thread_id, attrp, measure_benchmark_thread, &targs[i]);
+		if (rval != 0) {
+			fprintf(stderr, "Error: pthread_create failed (rval = %d)!\n", rval);
 			exit(EXIT_FAILURE);
 		}
 	}
-
-	if (arg_force_affinity) {
-		attrp = &attr;
+	for (i = 0; i < arg_num_threads; i++) {
+		rval = pthread_join(targs[i].thread_id, &thread_result);
+		if (rval != 0) {
+			fprintf(stderr, "Warning: pthread_join failed (rval = %d)!\n", rval);
+		}
 	}
+}
 
-	/* Seed random number generator with a constant seed to make the result reproducible */
-	srand(0xdeadbeef);
-
-	/* Less output when repeating */
-	if (arg_num_repeat > 1) {
-		quiet_mode = 1;
-	}
-	if (quiet_mode) {
-		measure_flags |= MEASURE_FLAG_NO_PRINT;
-	}
+/*
+ * Run the benchmark once in every thread and collect the measurements into the given state.
+ */
+static void phase_run(int (*func)(void *, long), long ntimes, thread_args_t *targs, pthread_attr_t *attrp, measure_state_t *state, int measure_flags) {
+	long i = 0;
 
+	if (arg_do_measure) measure_start(state, measure_flags);
+	phase_run_threads(func, ntimes, targs, attrp);
 	if (arg_do_measure) {
-		if (!measure_init_papi(measure_flags)) {
-			fprintf(stderr, "Warning: measure_init_papi failed, disabling measurements.\n");
-			arg_do_measure = 0;
-		}
-		if (!measure_init_thread(&measure_state, measure_flags)) {
-			fprintf(stderr, "Warning: measure_init_thread failed, disabling measurements.\n");
-			arg_do_measure = 0;
+		measure_stop(state, measure_flags);
+		for (i = 0; i < arg_num_threads; i++) {
+			measure_combine_perf_results(state, &targs[i].measure_state);
+			measure_cleanup(&targs[i].measure_state);
 		}
+		measure_print(state, measure_flags);
 	}
+}
 
-	/* Allocate data structures for threads */
-	targs = measure_alloc(arg_num_threads * sizeof(*targs));
-	if (targs == NULL) {
-		fprintf(stderr, "Error: measure_alloc failed!\n");
-		exit(EXIT_FAILURE);
+/*
+ * Store the results of the latest repetition and subtract the calibrated baseline.
+ */
+static void phase_store_sample(measure_state_t *state, measure_sample_t *sample, char quiet_mode) {
+	double time_elapsed = state->time_elapsed_before;
+	sample->time_elapsed = time_elapsed;
+	sample->uops_issued = state->event_1_before;
+	sample->idq_mite_uops = state->event_2_before;
+	sample->idq_dsb_uops = state->event_3_before;
+	sample->idq_ms_uops = state->event_4_before;
+	sample->pkg_power = state->pkg_power_before;
+	sample->pp0_power = state->pp0_power_before;
+	sample->pkg_temp = state->end_temp_pkg; /* sample pkg temperature at the end */
+	sample->pkg_temp_avg = (state->begin_temp_pkg + state->end_temp_pkg) / 2;
+
+	/* Dynamic power excludes idle power and the energy spent by the harness itself */
+	sample->pkg_dyn_power = sample->pkg_power - measure_baseline.idle_pkg_power;
+	sample->pp0_dyn_power = sample->pp0_power - measure_baseline.idle_pp0_power;
+	if (time_elapsed > 0) {
+		sample->pkg_dyn_power -= (measure_baseline.overhead_pkg_energy - measure_baseline.idle_pkg_power * measure_baseline.overhead_time) / time_elapsed;
+		sample->pp0_dyn_power -= (measure_baseline.overhead_pp0_energy - measure_baseline.idle_pp0_power * measure_baseline.overhead_time) / time_elapsed;
+	}
+
+	/* Power normalized to the reference temperature using the leakage model */
+	sample->pkg_power_tnorm = sample->pkg_power - measure_leakage.pkg_slope * (sample->pkg_temp_avg - arg_reference_temp);
+	sample->pp0_power_tnorm = sample->pp0_power - measure_leakage.pp0_slope * (sample->pkg_temp_avg - arg_reference_temp);
+
+	if (!quiet_mode && measure_baseline.idle_pkg_power != 0.0) {
+		printf("\n");
+		printf("PKG dynamic power:    %12.3f watts\n", sample->pkg_dyn_power);
+		printf("PP0 dynamic power:    %12.3f watts\n", sample->pp0_dyn_power);
+		fflush(stdout);
 	}
-
-	/* Call initialization hook for every thread structure */
-	for (i = 0; i < arg_num_threads; i++) {
-		/* Copy arguments */
-		targs[i].do_measure = arg_do_measure;
-		targs[i].init = bench->init;
-		rval = pthread_create(&targs[i].thread_id, NULL, measure_benchmark_init_thread, &targs[i]);
+	if (!quiet_mode && measure_leakage.num_points > 0) {
+		printf("\n");
+		printf("PKG power at %d C:    %12.3f watts\n", arg_reference_temp, sample->pkg_power_tnorm);
+		printf("PP0 power at %d C:    %12.3f watts\n", arg_reference_temp, sample->pp0_power_tnorm);
+		fflush(stdout);
 	}
-	for (i = 0; i < arg_num_threads; i++) {
-		rval = pthread_join(targs[i].thread_id, &thread_result);
+}
+
+/*
+ * Empty kernel for measuring the overhead of measure_start(), thread creation and measure_stop().
+ */
+static int calibration_empty_kernel(void *benchdata, long ntimes) {
+	(void)benchdata;
+	(void)ntimes;
+	return 1;
+}
+
+/*
+ * Number of empty kernel runs averaged when measuring the harness overhead.
+ */
+#define CALIBRATION_OVERHEAD_RUNS	100
+
+/*
+ * Calibration phase: measure idle power with all workers parked and the overhead of the measurement path.
+ */
+static void phase_calibrate(char quiet_mode, thread_args_t *targs, pthread_attr_t *attrp, measure_state_t *state) {
+	long i = 0;
+	double overhead_time = 0, overhead_pkg_energy = 0, overhead_pp0_energy = 0;
+
+	if (!quiet_mode) {
+		printf("Measuring idle power for %d seconds.\n", arg_calibration_time);
+		fflush(stdout);
 	}
 
-	// Print CSV-output column names
-	if (arg_do_measure && arg_num_repeat > 1) {
-		printf("num_threads"
-		       ",time_elapsed_normal,uops_issued_normal,idq_mite_normal,pkg_power_normal,pp0_power_normal,pkg_temp_normal"
-		       ",time_elapsed_extreme,uops_issued_extreme,idq_mite_extreme,pkg_power_extreme,pp0_power_extreme,pkg_temp_extreme"
-		       "\n");
+	/* No worker threads exist at this point, so the package is as idle as it gets */
+	measure_start(state, 0);
+	millisleep(arg_calibration_time * 1000);
+	measure_stop(state, 0);
+	measure_print(state, MEASURE_FLAG_NO_PRINT);
+	measure_baseline.idle_pkg_power = state->pkg_power_before;
+	measure_baseline.idle_pp0_power = state->pp0_power_before;
+
+	/* Run the empty kernel through the full measurement path */
+	for (i = 0; i < CALIBRATION_OVERHEAD_RUNS; i++) {
+		phase_run(calibration_empty_kernel, 0, targs, attrp, state, MEASURE_FLAG_NO_PRINT);
+		overhead_time += state->time_elapsed_before;
+		overhead_pkg_energy += state->pkg_power_before * state->time_elapsed_before;
+		overhead_pp0_energy += state->pp0_power_before * state->time_elapsed_before;
+	}
+	measure_baseline.overhead_time = overhead_time / CALIBRATION_OVERHEAD_RUNS;
+	measure_baseline.overhead_pkg_energy = overhead_pkg_energy / CALIBRATION_OVERHEAD_RUNS;
+	measure_baseline.overhead_pp0_energy = overhead_pp0_energy / CALIBRATION_OVERHEAD_RUNS;
+
+	/* Forget the calibration results so that the first delta printed is meaningful */
+	state->pkg_power_before = 0.0;
+	state->pp0_power_before = 0.0;
+	state->dram_power_before = 0.0;
+
+	if (!quiet_mode) {
+		printf("Idle PKG power:  %12.3f watts\n", measure_baseline.idle_pkg_power);
+		printf("Idle PP0 power:  %12.3f watts\n", measure_baseline.idle_pp0_power);
+		printf("Harness overhead: %12.6f seconds\t(%12.6f joules PKG, %12.6f joules PP0)\n",
+			measure_baseline.overhead_time, measure_baseline.overhead_pkg_energy, measure_baseline.overhead_pp0_energy);
 		fflush(stdout);
 	}
+}
 
-	/* Buffers for storing repeated measurements */
-	double *pkg_power_normal = NULL, *pp0_power_normal = NULL;
-	double *pkg_power_extreme = NULL, *pp0_power_extreme = NULL;
-	double *time_elapsed_normal = NULL, *time_elapsed_extreme = NULL;
-	double *uops_issued_normal = NULL, *uops_issued_extreme = NULL;
-	double *idq_mite_uops_normal = NULL, *idq_mite_uops_extreme = NULL;
-	double *pkg_temp_normal = NULL, *pkg_temp_extreme = NULL;
+/*
+ * Least squares fit of y = intercept + slope * x.
+ */
+static int fit_line(const double *x, const double *y, int n, double *slope, double *intercept) {
+	double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+	int i = 0;
 
-	/* Allocate buffers */
-	if (arg_do_measure) {
-		const long buffer_size = arg_num_repeat * sizeof(double);
-		pkg_power_normal = measure_alloc(buffer_size), pp0_power_normal = measure_alloc(buffer_size);
-		pkg_power_extreme = measure_alloc(buffer_size), pp0_power_extreme = measure_alloc(buffer_size);
-		time_elapsed_normal = measure_alloc(buffer_size), time_elapsed_extreme = measure_alloc(buffer_size);
-		uops_issued_normal = measure_alloc(buffer_size), uops_issued_extreme = measure_alloc(buffer_size);
-		idq_mite_uops_normal = measure_alloc(buffer_size), idq_mite_uops_extreme = measure_alloc(buffer_size);
-		pkg_temp_normal = measure_alloc(buffer_size), pkg_temp_extreme = measure_alloc(buffer_size);
+	for (i = 0; i < n; i++) {
+		sum_x += x[i];
+		sum_y += y[i];
+		sum_xx += x[i] * x[i];
+		sum_xy += x[i] * y[i];
 	}
+	double denominator = n * sum_xx - sum_x * sum_x;
+	if (n < 2 || denominator == 0.0) {
+		/* All points at the same temperature */
+		return 0;
+	}
+	*slope = (n * sum_xy - sum_x * sum_y) / denominator;
+	*intercept = (sum_y - *slope * sum_x) / n;
 
-	/* Warmup for normal version */
-	if (arg_benchmark_phase == -1 || arg_benchmark_phase == 1) {
-		phase_warmup(bench, quiet_mode, bench->normal, targs, attrp);
+	/* Success */
+	return 1;
+}
+
+/*
+ * Leakage calibration: run a fixed kernel in short samples while the package heats up from idle
+ * and fit power versus temperature.
+ */
+static void phase_calibrate_leakage(measure_benchmark_t *bench, char quiet_mode, thread_args_t *targs, pthread_attr_t *attrp, measure_state_t *state) {
+	/* Short samples give more points along the temperature curve */
+	long ntimes = bench->ntimes / 10 > 0 ? bench->ntimes / 10 : 1;
+	int max_points = 1024;
+	double *temp = measure_alloc(max_points * sizeof(double));
+	double *pkg_power = measure_alloc(max_points * sizeof(double));
+	double *pp0_power = measure_alloc(max_points * sizeof(double));
+	int n = 0;
+
+	if (!quiet_mode) {
+		printf("Running leakage calibration for %d seconds.\n", arg_leakage_time);
+		fflush(stdout);
 	}
 
-	/* Normal version */
-	if (arg_benchmark_phase == -1 || arg_benchmark_phase == 2) {
-		/* Repeat requested number of times */
-		for (j = 0; j < arg_num_repeat; j++) {
-			if (!quiet_mode) {
-				printf("\n");
-				printf("========================================================================\n");
-				printf("\n");
-				printf("Running %ld iterations of normal version\n", bench->ntimes);
-				fflush(stdout);
-			}
-			if (arg_do_measure) measure_start(&measure_state, measure_flags);
-			for (i = 0; i < arg_num_threads; i++) {
-				targs[i].benchmark = bench->normal;
-				targs[i].ntimes = bench->ntimes;
-				measure_set_thread_affinity(attrp, i);
-				rval = pthread_create(&targs[i].thread_id, attrp, measure_benchmark_thread, &targs[i]);
-				if (rval != 0) {
-					fprintf(stderr, "Error: pthread_create failed (rval = %d)!\n", rval);
-					exit(EXIT_FAILURE);
-				}
-			}
-			for (i = 0; i < arg_num_threads; i++) {
-				rval = pthread_join(targs[i].thread_id, &thread_result);
-				if (rval != 0) {
-					fprintf(stderr, "Warning: pthread_join failed (rval = %d)!\n", rval);
-				}
-			}
-			if (arg_do_measure) {
-				measure_stop(&measure_state, measure_flags);
-				for (i = 0; i < arg_num_threads; i++) {
-					measure_combine_perf_results(&measure_state, &targs[i].measure_state);
-					measure_cleanup(&targs[i].measure_state);
-				}
-				measure_print(&measure_state, measure_flags);
-				pkg_power_normal[j] = measure_state.pkg_power_before;
-				pp0_power_normal[j] = measure_state.pp0_power_before;
-				time_elapsed_normal[j] = measure_state.time_elapsed_before;
-				uops_issued_normal[j] = measure_state.event_1_before;
-				idq_mite_uops_normal[j] = measure_state.event_2_before;
-				pkg_temp_normal[j] = measure_state.end_temp_pkg; /* sample pkg temperature at the end */
-			}
+	double calibration_end = gettimeofday_double() + arg_leakage_time;
+	while (gettimeofday_double() < calibration_end && n < max_points) {
+		phase_run(bench->normal, ntimes, targs, attrp, state, MEASURE_FLAG_NO_PRINT);
+		if (state->begin_temp_pkg == 0 && state->end_temp_pkg == 0) {
+			/* No temperature readings available */
+			break;
 		}
+		temp[n] = (state->begin_temp_pkg + state->end_temp_pkg) / 2;
+		pkg_power[n] = state->pkg_power_before;
+		pp0_power[n] = state->pp0_power_before;
+		n++;
 	}
 
-	/* Warmup for extreme version */
-	if (arg_benchmark_phase == -1 || arg_benchmark_phase == 3) {
-		if (!quiet_mode) {
-			printf("\n");
-			printf("========================================================================\n");
-			printf("\n");
-		}
-		phase_warmup(bench, quiet_mode, bench->extreme, targs, attrp);
+	memset(&measure_leakage, 0, sizeof(measure_leakage));
+	if (fit_line(temp, pkg_power, n, &measure_leakage.pkg_slope, &measure_leakage.pkg_intercept) &&
+	    fit_line(temp, pp0_power, n, &measure_leakage.pp0_slope, &measure_leakage.pp0_intercept)) {
+		measure_leakage.num_points = n;
+	} else {
+		memset(&measure_leakage, 0, sizeof(measure_leakage));
+		fprintf(stderr, "Warning: Leakage calibration did not see enough temperature variation, disabling temperature normalization.\n");
 	}
 
-	/* Extreme unrolled version */
-	if (arg_benchmark_phase == -1 || arg_benchmark_phase == 4) {
-		/* Repeat requested number of times */
-		for (j = 0; j < arg_num_repeat; j++) {
-			if (!quiet_mode) {
-				printf("\n");
-				printf("========================================================================\n");
-				printf("\n");
-				printf("Running %ld iterations of extreme unrolled version\n", bench->ntimes);
-				fflush(stdout);
-			}
-			if (arg_do_measure) measure_start(&measure_state, measure_flags);
-			for (i = 0; i < arg_num_threads; i++) {
-				targs[i].benchmark = bench->extreme;
-				targs[i].ntimes = bench->ntimes;
-				measure_set_thread_affinity(attrp, i);
-				rval = pthread_create(&targs[i].thread_id, attrp, measure_benchmark_thread, &targs[i]);
-				if (rval != 0) {
-					fprintf(stderr, "Error: pthread_create failed (rval = %d)!\n", rval);
-					exit(EXIT_FAILURE);
-				}
-			}
-			for (i = 0; i < arg_num_threads; i++) {
-				rval = pthread_join(targs[i].thread_id, &thread_result);
-				if (rval != 0) {
-					fprintf(stderr, "Warning: pthread_join failed (rval = %d)!\n", rval);
-				}
+	/* Forget the calibration results so that the first delta printed is meaningful */
+	state->pkg_power_before = 0.0;
+	state->pp0_power_before = 0.0;
+	state->dram_power_before = 0.0;
+
+	if (!quiet_mode && measure_leakage.num_points > 0) {
+		printf("Leakage model from %d samples:\n", measure_leakage.num_points);
+		printf("PKG power: %12.3f watts %+8.4f watts/C\n", measure_leakage.pkg_intercept, measure_leakage.pkg_slope);
+		printf("PP0 power: %12.3f watts %+8.4f watts/C\n", measure_leakage.pp0_intercept, measure_leakage.pp0_slope);
+		fflush(stdout);
+	}
+
+	free(temp);
+	free(pkg_power);
+	free(pp0_power);
+}
+
+/*
+ * Give up waiting for the target temperature after this many seconds.
+ */
+#define COOLDOWN_TIMEOUT	600
+
+/*
+ * Duration of one filler kernel run in seconds.
+ */
+#define COOLDOWN_FILLER_TIME	0.1
+
+/*
+ * Wait until the package temperature is within the target band. If requested, the normal kernel is used
+ * as a filler to heat the package up when it is below the band.
+ */
+static void phase_cooldown(measure_benchmark_t *bench, char quiet_mode, thread_args_t *targs, pthread_attr_t *attrp) {
+	double temp = measure_read_pkg_temp();
+	long filler_ntimes = 0;
+	long i = 0;
+
+	if (temp < 0) {
+		fprintf(stderr, "Warning: Package temperature not available, skipping cooldown.\n");
+		return;
+	}
+	if (!quiet_mode) {
+		printf("Waiting for package temperature %.0f C to reach %d +- %d C.\n", temp, arg_cooldown_temp, arg_cooldown_band);
+		fflush(stdout);
+	}
+
+	/* The filler threads must not touch the performance counters */
+	for (i = 0; i < arg_num_threads; i++) {
+		targs[i].do_measure = 0;
+	}
+
+	double cooldown_start = gettimeofday_double();
+	while (1) {
+		temp = measure_read_pkg_temp();
+		if (temp > arg_cooldown_temp + arg_cooldown_band) {
+			millisleep(500);
+		} else if (temp < arg_cooldown_temp - arg_cooldown_band && arg_cooldown_filler) {
+			if (filler_ntimes == 0) {
+				/* Calibrate the filler kernel to run for roughly COOLDOWN_FILLER_TIME seconds */
+				long calibration_ntimes = bench->ntimes / 100 > 0 ? bench->ntimes / 100 : 1;
+				double calibration_start = gettimeofday_double();
+				phase_run_threads(bench->normal, calibration_ntimes, targs, attrp);
+				double calibration_duration = gettimeofday_double() - calibration_start;
+				filler_ntimes = calibration_duration > 0 ? calibration_ntimes * (COOLDOWN_FILLER_TIME / calibration_duration) : calibration_ntimes;
+				if (filler_ntimes < 1) filler_ntimes = 1;
+			}
+			phase_run_threads(bench->normal, filler_ntimes, targs, attrp);
+		} else {
+			break;
+		}
+		if (gettimeofday_double() - cooldown_start > COOLDOWN_TIMEOUT) {
+			fprintf(stderr, "Warning: Package temperature did not reach the target band in %d seconds.\n", COOLDOWN_TIMEOUT);
+			break;
+		}
+	}
+
+	for (i = 0; i < arg_num_threads; i++) {
+		targs[i].do_measure = arg_do_measure;
+	}
+
+	if (!quiet_mode) {
+		printf("Package temperature %.0f C after %f seconds.\n", temp, gettimeofday_double() - cooldown_start);
+		fflush(stdout);
+	}
+}
+
+/*
+ * Fraction of a sweep point's iterations used for probing its running time.
+ */
+#define SWEEP_PROBE_DIVISOR	10
+
+/*
+ * Set the swept parameter in every worker thread. Returns the effective value reported by the benchmark.
+ */
+static long phase_set_param(measure_benchmark_t *bench, long value, thread_args_t *targs) {
+	long i = 0;
+	int rval = 0;
+	void *thread_result = NULL;
+
+	for (i = 0; i < arg_num_threads; i++) {
+		targs[i].set_param = bench->set_param;
+		targs[i].param = value;
+		rval = pthread_create(&targs[i].thread_id, NULL, measure_benchmark_param_thread, &targs[i]);
+		if (rval != 0) {
+			fprintf(stderr, "Error: pthread_create failed (rval = %d)!\n", rval);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = 0; i < arg_num_threads; i++) {
+		rval = pthread_join(targs[i].thread_id, &thread_result);
+		if (rval != 0) {
+			fprintf(stderr, "Warning: pthread_join failed (rval = %d)!\n", rval);
+		}
+		if (targs[i].param < 0) {
+			fprintf(stderr, "Error: Setting %s to %ld failed!\n", bench->param_name, value);
+			exit(EXIT_FAILURE);
+		}
+	}
+	return targs[0].param;
+}
+
+/*
+ * Choose the number of iterations for a sweep point. The work is first scaled inversely to size-like parameters,
+ * then a short probe run corrects for the changing speed so that every point lasts as long as the first one.
+ */
+static long phase_sweep_ntimes(measure_benchmark_t *bench, long value, thread_args_t *targs, pthread_attr_t *attrp, double *target_time) {
+	long ntimes = bench->ntimes;
+	long probe_ntimes = 0;
+	long i = 0;
+
+	if (bench->param_default > 0 && value > 0) {
+		ntimes = bench->ntimes * ((double)bench->param_default / value);
+	}
+
+	if (ntimes < 1) ntimes = 1;
+	probe_ntimes = ntimes / SWEEP_PROBE_DIVISOR > 0 ? ntimes / SWEEP_PROBE_DIVISOR : 1;
+
+	/* The probe threads must not touch the performance counters */
+	for (i = 0; i < arg_num_threads; i++) {
+		targs[i].do_measure = 0;
+	}
+	double probe_start = gettimeofday_double();
+	phase_run_threads(bench->normal, probe_ntimes, targs, attrp);
+	double probe_duration = gettimeofday_double() - probe_start;
+	for (i = 0; i < arg_num_threads; i++) {
+		targs[i].do_measure = arg_do_measure;
+	}
+
+	if (*target_time <= 0) {
+		/* The first sweep point sets the target duration */
+		*target_time = probe_duration * ((double)ntimes / probe_ntimes);
+	} else if (probe_duration > 0) {
+		ntimes = probe_ntimes * (*target_time / probe_duration);
+	}
+	if (ntimes < 1) ntimes = 1;
+	return ntimes;
+}
+
+/*
+ * Parse a size with an optional k, M or G suffix (powers of 1024).
+ */
+static long parse_size(const char *str, char **endptr) {
+	long value = strtol(str, endptr, 10);
+	switch (**endptr) {
+		case 'k': case 'K': value *= 1024L; (*endptr)++; break;
+		case 'm': case 'M': value *= 1024L * 1024L; (*endptr)++; break;
+		case 'g': case 'G': value *= 1024L * 1024L * 1024L; (*endptr)++; break;
+	}
+	return value;
+}
+
+/*
+ * Run the requested number of measured repetitions of one kernel. The optional report hook is called
+ * after every repetition with the benchdata of every thread.
+ */
+static void phase_measure(int (*func)(void *, long), void (*report)(void **, int), long ntimes, const char *version, measure_sample_t *samples, char quiet_mode, thread_args_t *targs, pthread_attr_t *attrp, measure_state_t *state, int measure_flags) {
+	void **benchdata = NULL;
+	long i = 0, j = 0;
+
+	if (report) {
+		benchdata = measure_alloc(arg_num_threads * sizeof(*benchdata));
+		for (i = 0; i < arg_num_threads; i++) {
+			benchdata[i] = targs[i].benchdata;
+		}
+	}
+
+	for (j = 0; j < arg_num_repeat; j++) {
+		if (!quiet_mode) {
+			printf("\n");
+			printf("========================================================================\n");
+			printf("\n");
+			printf("Running %ld iterations of %s version\n", ntimes, version);
+			fflush(stdout);
+		}
+		phase_run(func, ntimes, targs, attrp, state, measure_flags);
+		if (arg_do_measure) {
+			phase_store_sample(state, &samples[j], quiet_mode);
+		}
+		if (report) {
+			report(benchdata, arg_num_threads);
+		}
+	}
+	free(benchdata);
+}
+
+/*
+ * Rate of the given programmable counter (1-4) in a sample.
+ */
+static double sample_counter(const measure_sample_t *sample, int counter) {
+	switch (counter) {
+	case 1: return sample->uops_issued;
+	case 2: return sample->idq_mite_uops;
+	case 3: return sample->idq_dsb_uops;
+	default: return sample->idq_ms_uops;
+	}
+}
+
+/*
+ * The cost per mispredict and resteer needs the branch events of the benchmark in counters 2-4.
+ */
+static int branch_columns(measure_benchmark_t *bench) {
+	return bench->branch_events && arg_perf_events[1] == NULL && arg_perf_events[2] == NULL && arg_perf_events[3] == NULL;
+}
+
+/*
+ * Print the compact CSV rows. The swept parameter, if any, goes into the first column.
+ * Benchmarks which count their operations get the energy and uops per operation appended, optionally
+ * followed by one event per operation, and benchmarks counting branch events the energy and wasted uops per mispredict and resteer.
+ */
+static void print_samples(measure_benchmark_t *bench, long param, long ntimes, measure_sample_t *samples_normal, measure_sample_t *samples_extreme) {
+	double ops = (double)ntimes * bench->ops_per_iteration * arg_num_threads;
+	long j = 0;
+
+	/* The operations per iteration are counted at the default parameter and scale with it */
+	if (arg_do_sweep && bench->param_default > 0) {
+		ops *= (double)param / bench->param_default;
+	}
+
+	for (j = 0; j < arg_num_repeat; j++) {
+		measure_sample_t *n = &samples_normal[j], *e = &samples_extreme[j];
+		if (arg_do_sweep) {
+			printf("%ld,", param);
+		}
+		printf("%d,%f,%.0f,%.0f,%.0f,%.0f,%f,%f,%f,%f,%f,%f,%.0f,%.1f,%f,%.0f,%.0f,%.0f,%.0f,%f,%f,%f,%f,%f,%f,%.0f,%.1f", arg_num_threads,
+			n->time_elapsed, n->uops_issued, n->idq_mite_uops, n->idq_dsb_uops, n->idq_ms_uops,
+			n->pkg_power, n->pp0_power, n->pkg_dyn_power, n->pp0_dyn_power,
+			n->pkg_power_tnorm, n->pp0_power_tnorm, n->pkg_temp, n->pkg_temp_avg,
+			e->time_elapsed, e->uops_issued, e->idq_mite_uops, e->idq_dsb_uops, e->idq_ms_uops,
+			e->pkg_power, e->pp0_power, e->pkg_dyn_power, e->pp0_dyn_power,
+			e->pkg_power_tnorm, e->pp0_power_tnorm, e->pkg_temp, e->pkg_temp_avg);
+		if (ops > 0) {
+			/* Energy in nanojoules, the powers and event rates are per second */
+			printf(",%.0f,%f,%f,%f,%f,%f,%f", ops,
+				n->pkg_power * n->time_elapsed / ops * 1e9, n->pkg_dyn_power * n->time_elapsed / ops * 1e9, n->uops_issued * n->time_elapsed / ops,
+				e->pkg_power * e->time_elapsed / ops * 1e9, e->pkg_dyn_power * e->time_elapsed / ops * 1e9, e->uops_issued * e->time_elapsed / ops);
+			if (bench->per_op_counter > 0) {
+				printf(",%f,%f", sample_counter(n, bench->per_op_counter) * n->time_elapsed / ops,
+					sample_counter(e, bench->per_op_counter) * e->time_elapsed / ops);
+			}
+		}
+		if (branch_columns(bench)) {
+			/* Extra energy and issued but not retired uops of the extreme version per extra mispredict and resteer,
+			 * from the counts of both versions since their running times differ */
+			double energy = e->pkg_power * e->time_elapsed - n->pkg_power * n->time_elapsed;
+			double wasted = (e->uops_issued - e->idq_mite_uops) * e->time_elapsed - (n->uops_issued - n->idq_mite_uops) * n->time_elapsed;
+			double mispredicts = e->idq_dsb_uops * e->time_elapsed - n->idq_dsb_uops * n->time_elapsed;
+			double resteers = e->idq_ms_uops * e->time_elapsed - n->idq_ms_uops * n->time_elapsed;
+			printf(",%f,%f,%f,%f",
+				mispredicts > 0 ? energy / mispredicts * 1e9 : 0, mispredicts > 0 ? wasted / mispredicts : 0,
+				resteers > 0 ? energy / resteers * 1e9 : 0, resteers > 0 ? wasted / resteers : 0);
+		}
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+/*
+ * Parsed command line parameters
+ */
+char arg_do_measure        = 0;
+char arg_use_64bit_numbers = 0;
+int  arg_benchmark_phase   = -1;
+int  arg_num_threads       = 1;
+int  arg_num_repeat        = 1;
+int  arg_multiplier        = 1;
+int  arg_warmup_time       = 120; /* 2 minutes */
+char arg_force_affinity    = 0;
+int  arg_calibration_time  = 0; /* disabled */
+int  arg_leakage_time      = 0; /* disabled */
+int  arg_reference_temp    = 50; /* degrees C */
+int  arg_cooldown_temp     = 0; /* disabled */
+int  arg_cooldown_band     = 1; /* degrees C */
+char arg_cooldown_filler   = 0;
+char arg_do_sweep          = 0;
+long arg_sweep_from        = 0;
+long arg_sweep_to          = 0;
+double arg_sweep_factor    = 2;
+long arg_sweep_step        = 0; /* geometric */
+const char *arg_input_file = NULL;
+const char *arg_perf_events[4] = { NULL, NULL, NULL, NULL };
+char arg_huge_pages        = 0;
+int  arg_num_accumulators  = 1;
+const char *arg_data_pattern = NULL; /* random */
+int  arg_mxcsr_bits        = 0; /* MEASURE_MXCSR_FTZ and MEASURE_MXCSR_DAZ */
+int  arg_vector_width      = 0; /* widest supported */
+
+/*
+ * Select the programmable events: the -e option takes precedence over the benchmark's own counters,
+ * which take precedence over the defaults. Returns 1 if any event differs from the default.
+ */
+static int select_perf_events(measure_benchmark_t *bench) {
+	int slot = 0, changed = 0;
+	for (slot = 0; slot < 4; slot++) {
+		if (arg_perf_events[slot] != NULL) {
+			*perf_event_names[slot] = arg_perf_events[slot];
+			*perf_event_pretty_names[slot] = arg_perf_events[slot];
+		} else if (bench->counters[slot].name != NULL) {
+			*perf_event_names[slot] = bench->counters[slot].name;
+			*perf_event_pretty_names[slot] = bench->counters[slot].desc != NULL ? bench->counters[slot].desc : bench->counters[slot].name;
+		} else {
+			*perf_event_names[slot] = perf_event_default_names[slot];
+			*perf_event_pretty_names[slot] = perf_event_default_pretty_names[slot];
+		}
+		if (strcmp(*perf_event_names[slot], perf_event_default_names[slot]) != 0) {
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+/*
+ * Size and 2 MB page coverage of the text segment, filled in by remap_text_huge_pages
+ */
+static int text_remapped = 0;
+static unsigned long text_bytes = 0;
+static unsigned long text_huge_bytes = 0;
+static uintptr_t text_lo = 0, text_hi = 0;
+
+/*
+ * Find the executable mapping containing addr in /proc/self/maps, along with the end of the
+ * previous mapping and the start of the next one. Returns 0 if not found.
+ */
+static int find_text_mapping(uintptr_t addr, uintptr_t *start, uintptr_t *end, uintptr_t *prev_end, uintptr_t *next_start) {
+	FILE *fp = fopen("/proc/self/maps", "r");
+	char line[4096], perms[5];
+	unsigned long lo = 0, hi = 0, last_end = 0;
+	int found = 0;
+
+	if (fp == NULL) {
+		return 0;
+	}
+	*next_start = UINTPTR_MAX;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%lx-%lx %4s", &lo, &hi, perms) != 3) {
+			continue;
+		}
+		if (found) {
+			*next_start = lo;
+			break;
+		}
+		if (addr >= lo && addr < hi && perms[2] == 'x') {
+			*start = lo;
+			*end = hi;
+			*prev_end = last_end;
+			found = 1;
+		}
+		last_end = hi;
+	}
+	fclose(fp);
+	return found;
+}
+
+/*
+ * Sum of AnonHugePages in /proc/self/smaps over the mappings overlapping [lo, hi).
+ */
+static unsigned long huge_page_bytes(uintptr_t lo, uintptr_t hi) {
+	FILE *fp = fopen("/proc/self/smaps", "r");
+	char line[4096];
+	unsigned long start = 0, end = 0, kb = 0, total = 0;
+	int inside = 0;
+
+	if (fp == NULL) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			inside = start < hi && end > lo;
+		} else if (inside && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+			total += kb * 1024;
+		}
+	}
+	fclose(fp);
+	return total;
+}
+
+/*
+ * Sum of AnonHugePages in /proc/self/smaps over the anonymous executable mappings outside the
+ * remapped text segment, i.e. the code buffers of the JIT benchmarks.
+ */
+static unsigned long jit_huge_page_bytes(void) {
+	FILE *fp = fopen("/proc/self/smaps", "r");
+	char line[4096], perms[5];
+	unsigned long start = 0, end = 0, inode = 0, kb = 0, total = 0;
+	int inside = 0, path = 0;
+
+	if (fp == NULL) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%lx-%lx %4s %*s %*s %lu %n", &start, &end, perms, &inode, &path) == 4) {
+			/* No path and no inode, which excludes [vdso] and the file-backed mappings */
+			inside = perms[2] == 'x' && inode == 0 && line[path] == '\0' &&
+			         !(start < text_hi && end > text_lo);
+		} else if (inside && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+			total += kb * 1024;
+		}
+	}
+	fclose(fp);
+	return total;
+}
+
+/*
+ * Move the text segment onto 2 MB pages: copy it to an aligned anonymous region backed by
+ * transparent huge pages and mremap that over the original file-backed mapping. The segment is
+ * widened to 2 MB boundaries where nothing else is mapped, which the linker guarantees with
+ * -z max-page-size=0x200000. Only a warning is printed on failure, the benchmark still runs on 4 kB pages.
+ */
+static void remap_text_huge_pages(void) {
+	uintptr_t start = 0, end = 0, prev_end = 0, next_start = 0, lo = 0, hi = 0, copy_lo = 0, copy_hi = 0;
+	char *reserved = NULL, *aligned = NULL;
+	size_t len = 0;
+
+	if (!find_text_mapping((uintptr_t)&measure_main, &start, &end, &prev_end, &next_start)) {
+		fprintf(stderr, "Warning: Could not find the text segment in /proc/self/maps.\n");
+		return;
+	}
+	text_bytes = end - start;
+	lo = start & ~(MEASURE_HUGE_PAGE_SIZE - 1);
+	hi = (end + MEASURE_HUGE_PAGE_SIZE - 1) & ~(MEASURE_HUGE_PAGE_SIZE - 1);
+	if (lo < prev_end) {
+		lo = (start + MEASURE_HUGE_PAGE_SIZE - 1) & ~(MEASURE_HUGE_PAGE_SIZE - 1);
+	}
+	if (hi > next_start) {
+		hi = end & ~(MEASURE_HUGE_PAGE_SIZE - 1);
+	}
+	if (hi <= lo) {
+		fprintf(stderr, "Warning: The text segment does not cover a whole 2 MB page, link with -z max-page-size=0x200000.\n");
+		return;
+	}
+	len = hi - lo;
+	copy_lo = lo > start ? lo : start;
+	copy_hi = hi < end ? hi : end;
+
+	/* Reserve an extra huge page to align the copy */
+	reserved = mmap(NULL, len + MEASURE_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (reserved == MAP_FAILED) {
+		fprintf(stderr, "Warning: mmap for the text segment copy failed.\n");
+		return;
+	}
+	aligned = (char *)(((uintptr_t)reserved + MEASURE_HUGE_PAGE_SIZE - 1) & ~(MEASURE_HUGE_PAGE_SIZE - 1));
+	if (madvise(aligned, len, MADV_HUGEPAGE) != 0) {
+		fprintf(stderr, "Warning: madvise(MADV_HUGEPAGE) failed, transparent huge pages may be disabled.\n");
+	}
+	memcpy(aligned + (copy_lo - lo), (const void *)copy_lo, copy_hi - copy_lo);
+	if (mprotect(aligned, len, PROT_READ | PROT_EXEC) != 0 ||
+	    mremap(aligned, len, len, MREMAP_MAYMOVE | MREMAP_FIXED, (void *)lo) == MAP_FAILED) {
+		fprintf(stderr, "Warning: Remapping the text segment failed.\n");
+		munmap(reserved, len + MEASURE_HUGE_PAGE_SIZE);
+		return;
+	}
+
+	/* Release the unused parts of the reservation */
+	if (aligned > reserved) {
+		munmap(reserved, aligned - reserved);
+	}
+	munmap(aligned + len, reserved + MEASURE_HUGE_PAGE_SIZE - aligned);
+	text_huge_bytes = huge_page_bytes(lo, hi);
+	text_lo = lo;
+	text_hi = hi;
+}
+
+/*
+ * Data patterns of the kernel inputs, selected with -d. Integer arrays get the pattern in every bit of an element,
+ * floating point arrays in the significand of values between 1 and 2, so that the values stay finite and normal.
+ * The random pattern keeps the integer-valued numbers of the original benchmarks.
+ */
+typedef enum {
+	DATA_RANDOM = 0, DATA_ZEROS, DATA_ONES, DATA_ALTERNATING, DATA_HAMMING, DATA_DENORMAL, DATA_UNDERFLOW, DATA_NAN
+} data_pattern_t;
+
+static data_pattern_t data_pattern = DATA_RANDOM;
+static int data_hamming_weight = 0;
+static int data_percent = 100; /* Share of denormal or underflowing values */
+static uint64_t data_seed = 0xdeadbeef; /* constant to make the result reproducible */
+
+/*
+ * Per-thread xorshift64* generator, seeded from the -d seed on first use so that every worker thread fills
+ * its arrays with the same numbers regardless of scheduling.
+ */
+static __thread uint64_t rng_state = 0;
+
+uint64_t measure_rand64(void) {
+	if (rng_state == 0) {
+		/* splitmix64 finalizer, made odd so that the state is never zero */
+		uint64_t z = data_seed + 0x9e3779b97f4a7c15ULL;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		rng_state = (z ^ (z >> 31)) | 1;
+	}
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+/*
+ * Bit pattern of the given width with the selected pattern. Denormals, underflows and NaNs only exist in floating point.
+ */
+static uint64_t data_pattern_bits(int bits) {
+	uint64_t mask = bits < 64 ? (1ULL << bits) - 1 : ~0ULL;
+	uint64_t value = 0;
+	int weight = 0;
+
+	switch (data_pattern) {
+	case DATA_ZEROS: return 0;
+	case DATA_ONES: return mask;
+	case DATA_ALTERNATING: return 0x5555555555555555ULL & mask;
+	case DATA_HAMMING:
+		/* Set random bits until the weight is reached */
+		weight = data_hamming_weight < bits ? data_hamming_weight : bits;
+		while (__builtin_popcountll(value) < weight) {
+			value |= 1ULL << (measure_rand64() % bits);
+		}
+		return value;
+	default: return measure_rand64() & mask;
+	}
+}
+
+/*
+ * Fill an integer array of elements of the given size in bytes.
+ */
+void measure_fill_int_array(void *array, long n, size_t size) {
+	unsigned char *p = array;
+	long i = 0;
+
+	for (i = 0; i < n; i++) {
+		uint64_t value = 0;
+		if (data_pattern == DATA_RANDOM || data_pattern == DATA_DENORMAL || data_pattern == DATA_UNDERFLOW || data_pattern == DATA_NAN) {
+			value = arg_use_64bit_numbers ? rand64() : rand32();
+		} else {
+			value = data_pattern_bits(size * 8);
+		}
+		/* Little-endian: the low bytes hold the value */
+		memcpy(p + i * size, &value, size);
+	}
+}
+
+/*
+ * Fill a float or double array, selected by the element size in bytes.
+ */
+void measure_fill_float_array(void *array, long n, size_t size) {
+	const int mantissa_bits = size == sizeof(double) ? 52 : 23;
+	const int bias = size == sizeof(double) ? 1023 : 127;
+	const uint64_t one = (uint64_t)bias << mantissa_bits;
+	/* The product of two values with this exponent lies in the middle of the subnormal range */
+	const uint64_t tiny = (uint64_t)(bias - (bias + mantissa_bits / 2) / 2) << mantissa_bits;
+	const uint64_t quiet_nan = size == sizeof(double) ? 0x7ff8000000000000ULL : 0x7fc00000ULL;
+	unsigned char *p = array;
+	long i = 0;
+
+	for (i = 0; i < n; i++) {
+		uint64_t bits = 0;
+		double d = 0;
+		float f = 0;
+		switch (data_pattern) {
+		case DATA_RANDOM:
+			d = arg_use_64bit_numbers ? (double)rand64() : (float)(rand32() >> 1);
+			f = d;
+			if (size == sizeof(double)) {
+				memcpy(&bits, &d, sizeof(d));
+			} else {
+				memcpy(&bits, &f, sizeof(f));
 			}
-			if (arg_do_measure) {
-				measure_stop(&measure_state, measure_flags);
-				for (i = 0; i < arg_num_threads; i++) {
-					measure_combine_perf_results(&measure_state, &targs[i].measure_state);
-					measure_cleanup(&targs[i].measure_state);
+			break;
+		case DATA_ZEROS:
+			break;
+		case DATA_DENORMAL:
+		case DATA_UNDERFLOW:
+			/* The given percentage of subnormal or tiny values, the rest between 1 and 2 */
+			bits = (measure_rand64() & ((1ULL << mantissa_bits) - 1)) | 1;
+			if ((int)(measure_rand64() % 100) >= data_percent) {
+				bits |= one;
+			} else if (data_pattern == DATA_UNDERFLOW) {
+				bits |= tiny;
+			}
+			break;
+		case DATA_NAN:
+			bits = quiet_nan;
+			break;
+		default:
+			bits = one | data_pattern_bits(mantissa_bits);
+			break;
+		}
+		memcpy(p + i * size, &bits, size);
+	}
+}
+
+/*
+ * Parse a data pattern: zeros, ones, alternating, hw:<n>, random[:<seed>], denormal[:<percent>], underflow[:<percent>] or nan.
+ */
+static int parse_data_pattern(const char *str) {
+	char *end = NULL;
+	if (strcmp(str, "zeros") == 0) {
+		data_pattern = DATA_ZEROS;
+	} else if (strcmp(str, "ones") == 0) {
+		data_pattern = DATA_ONES;
+	} else if (strcmp(str, "alternating") == 0) {
+		data_pattern = DATA_ALTERNATING;
+	} else if (strncmp(str, "hw:", 3) == 0) {
+		data_pattern = DATA_HAMMING;
+		data_hamming_weight = strtol(str + 3, &end, 10);
+		if (end == str + 3 || *end != '\0' || data_hamming_weight < 0 || data_hamming_weight > 64) return 0;
+	} else if (strncmp(str, "random", 6) == 0) {
+		data_pattern = DATA_RANDOM;
+		if (str[6] == ':') {
+			data_seed = strtoull(str + 7, &end, 0);
+			if (end == str + 7 || *end != '\0') return 0;
+		} else if (str[6] != '\0') {
+			return 0;
+		}
+	} else if (strncmp(str, "denormal", 8) == 0 || strncmp(str, "underflow", 9) == 0) {
+		const char *rest = str[0] == 'd' ? str + 8 : str + 9;
+		data_pattern = str[0] == 'd' ? DATA_DENORMAL : DATA_UNDERFLOW;
+		if (rest[0] == ':') {
+			data_percent = strtol(rest + 1, &end, 10);
+			if (end == rest + 1 || *end != '\0' || data_percent < 0 || data_percent > 100) return 0;
+		} else if (rest[0] != '\0') {
+			return 0;
+		}
+	} else if (strcmp(str, "nan") == 0) {
+		data_pattern = DATA_NAN;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Widest vector width in bits supported by the CPU, from CPUID. The 512-bit kernels also use AVX-512 BW and DQ,
+ * and the 128-bit kernels SSE4.1, so 0 means no vector kernels at all.
+ */
+static int cpu_vector_width(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq")) {
+		return 512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return 256;
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		return 128;
+	}
+	return 0;
+}
+
+int measure_vector_width(void) {
+	return arg_vector_width > 0 ? arg_vector_width : cpu_vector_width();
+}
+
+int measure_main(int argc, char **argv, measure_benchmark_t *bench) {
+	long i = 0;
+	thread_args_t *targs = NULL;
+	void *thread_result = NULL;
+	int measure_flags = 0;
+	int rval = 0;
+	measure_state_t measure_state;
+	char quiet_mode = 0;
+	int perf_events_changed = 0;
+	memset(&measure_state, 0, sizeof(measure_state));
+	pthread_attr_t attr, *attrp = NULL;
+	pthread_attr_init(&attr);
+
+	/* Process command line arguments */
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-A") == 0) {
+			/* Number of independent accumulators in the reduction kernels: 1, 2, 4, 8 or 16 */
+			if (i + 1 < argc) {
+				i++;
+				arg_num_accumulators = atoi(argv[i]);
+				if (arg_num_accumulators < 1 || arg_num_accumulators > 16 || (arg_num_accumulators & (arg_num_accumulators - 1)) != 0) {
+					fprintf(stderr, "Error: Invalid number of accumulators \"%s\", use 1, 2, 4, 8 or 16.\n", argv[i]);
+					exit(EXIT_FAILURE);
 				}
-				measure_print(&measure_state, measure_flags);
-				pkg_power_extreme[j] = measure_state.pkg_power_before;
-				pp0_power_extreme[j] = measure_state.pp0_power_before;
-				time_elapsed_extreme[j] = measure_state.time_elapsed_before;
-				uops_issued_extreme[j] = measure_state.event_1_before;
-				idq_mite_uops_extreme[j] = measure_state.event_2_before;
-				pkg_temp_extreme[j] = measure_state.end_temp_pkg; /* sample pkg temperature at the end */
 			}
 		}
+		else if (strcmp(argv[i], "-a") == 0) {
+			/* Force the CPU affinity of benchmark threads */
+			arg_force_affinity = 1;
+		}
+		else if (strcmp(argv[i], "-b") == 0) {
+			/* Use either 64-bit integers or double-precision floating point */
+			arg_use_64bit_numbers = 1;
+		}
+		else if (strcmp(argv[i], "-C") == 0) {
+			/* Wait for the package temperature to reach <target>[:<band>] degrees C before each warmup and measured phase */
+			if (i + 1 < argc) {
+				i++;
+				if (sscanf(argv[i], "%d:%d", &arg_cooldown_temp, &arg_cooldown_band) < 1) {
+					fprintf(stderr, "Error: Invalid cooldown temperature \"%s\".\n", argv[i]);
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+		else if (strcmp(argv[i], "-c") == 0) {
+			/* Idle power calibration time in seconds */
+			if (i + 1 < argc) {
+				i++;
+				arg_calibration_time = atoi(argv[i]);
+			}
+		}
+		else if (strcmp(argv[i], "-d") == 0) {
+			/* Data pattern of the kernel inputs */
+			if (i + 1 < argc) {
+				i++;
+				arg_data_pattern = argv[i];
+				if (!parse_data_pattern(arg_data_pattern)) {
+					fprintf(stderr, "Error: Invalid data pattern \"%s\", use zeros, ones, alternating, hw:<n>, random[:<seed>], denormal[:<percent>], underflow[:<percent>] or nan.\n", argv[i]);
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+		else if (strcmp(argv[i], "-f") == 0) {
+			/* Input file for benchmarks which read their kernel description from a file */
+			if (i + 1 < argc) {
+				i++;
+				arg_input_file = argv[i];
+			}
+		}
+		else if (strcmp(argv[i], "-e") == 0) {
+			/* Replace a programmable event: <slot 1-4>=<event name> */
+			if (i + 1 < argc) {
+				i++;
+				const char *eq = strchr(argv[i], '=');
+				int slot = atoi(argv[i]);
+				if (eq == NULL || slot < 1 || slot > 4 || eq[1] == '\0') {
+					fprintf(stderr, "Error: Invalid event \"%s\", use <slot 1-4>=<event name>.\n", argv[i]);
+					exit(EXIT_FAILURE);
+				}
+				arg_perf_events[slot - 1] = eq + 1;
+			}
+		}
+		else if (strcmp(argv[i], "-F") == 0) {
+			/* Run the normal kernel as a filler when the package is colder than the cooldown target */
+			arg_cooldown_filler = 1;
+		}
+		else if (strcmp(argv[i], "-H") == 0) {
+			/* Put the text segment and large JIT buffers on 2 MB pages */
+			arg_huge_pages = 1;
+		}
+		else if (strcmp(argv[i], "-l") == 0) {
+			/* Leakage calibration time in seconds */
+			if (i + 1 < argc) {
+				i++;
+				arg_leakage_time = atoi(argv[i]);
+			}
+		}
+		else if (strcmp(argv[i], "-m") == 0) {
+			/* Measure timing, performance and power consumption */
+			arg_do_measure = 1;
+		}
+		else if (strcmp(argv[i], "-n") == 0) {
+			/* Multiply the running time of micro benchmarks by a given factor */
+			if (i + 1 < argc) {
+				i++;
+				arg_multiplier = atoi(argv[i]);
+				bench->ntimes *= arg_multiplier;
+			}
+		}
+		else if (strcmp(argv[i], "-p") == 0) {
+			/* Only execute a specific benchmark phase (calibration = 0, warmup = 1, normal = 2, warmup = 3, or extreme = 4) */
+			if (i + 1 < argc) {
+				i++;
+				arg_benchmark_phase = atoi(argv[i]);
+			}
+		}
+		else if (strcmp(argv[i], "-r") == 0) {
+			/* Number of times to repeat */
+			if (i + 1 < argc) {
+				i++;
+				arg_num_repeat = atoi(argv[i]);
+			}
+		}
+		else if (strcmp(argv[i], "-s") == 0) {
+			/* Sweep the benchmark parameter over <from>:<to>[:<factor>], or linearly with <from>:<to>:+<step> */
+			if (i + 1 < argc) {
+				char *end = NULL;
+				i++;
+				arg_do_sweep = 1;
+				arg_sweep_from = parse_size(argv[i], &end);
+				if (*end == ':') {
+					arg_sweep_to = parse_size(end + 1, &end);
+				}
+				if (end[0] == ':' && end[1] == '+') {
+					arg_sweep_step = parse_size(end + 2, &end);
+				} else if (*end == ':') {
+					arg_sweep_factor = strtod(end + 1, &end);
+				}
+				if (*end != '\0' || arg_sweep_from < 0 || arg_sweep_to < arg_sweep_from ||
+				    (arg_sweep_step == 0 && (arg_sweep_from == 0 || arg_sweep_factor <= 1)) || arg_sweep_step < 0) {
+					fprintf(stderr, "Error: Invalid sweep range \"%s\".\n", argv[i]);
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+		else if (strcmp(argv[i], "-T") == 0) {
+			/* Reference temperature for temperature-normalized power */
+			if (i + 1 < argc) {
+				i++;
+				arg_reference_temp = atoi(argv[i]);
+			}
+		}
+		else if (strcmp(argv[i], "-t") == 0) {
+			/* Number of threads */
+			if (i + 1 < argc) {
+				i++;
+				arg_num_threads = atoi(argv[i]);
+			}
+		}
+		else if (strcmp(argv[i], "-V") == 0) {
+			/* Vector width of the vectorized kernels: sse, avx2 or avx512 */
+			if (i + 1 < argc) {
+				i++;
+				if (strcmp(argv[i], "sse") == 0) {
+					arg_vector_width = 128;
+				} else if (strcmp(argv[i], "avx2") == 0) {
+					arg_vector_width = 256;
+				} else if (strcmp(argv[i], "avx512") == 0) {
+					arg_vector_width = 512;
+				} else {
+					fprintf(stderr, "Error: Invalid vector width \"%s\", use sse, avx2 or avx512.\n", argv[i]);
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+		else if (strcmp(argv[i], "-w") == 0) {
+			/* Warmup time in seconds */
+			if (i + 1 < argc) {
+				i++;
+				arg_warmup_time = atoi(argv[i]);
+			}
+		}
+		else if (strcmp(argv[i], "-Z") == 0) {
+			/* Flush-to-zero and denormals-are-zero in the worker threads: ftz, daz or ftz,daz */
+			if (i + 1 < argc) {
+				i++;
+				if (strcmp(argv[i], "ftz") == 0) {
+					arg_mxcsr_bits = MEASURE_MXCSR_FTZ;
+				} else if (strcmp(argv[i], "daz") == 0) {
+					arg_mxcsr_bits = MEASURE_MXCSR_DAZ;
+				} else if (strcmp(argv[i], "ftz,daz") == 0 || strcmp(argv[i], "daz,ftz") == 0) {
+					arg_mxcsr_bits = MEASURE_MXCSR_FTZ | MEASURE_MXCSR_DAZ;
+				} else {
+					fprintf(stderr, "Error: Invalid floating point mode \"%s\", use ftz, daz or ftz,daz.\n", argv[i]);
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+		else {
+			fprintf(stderr, "Error: Unrecognized option \"%s\".\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (arg_force_affinity) {
+		attrp = &attr;
+	}
+
+	if (arg_do_sweep && bench->set_param == NULL) {
+		fprintf(stderr, "Error: Benchmark %s has no parameter to sweep.\n", bench->name);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Skip the benchmark, so that a pattern matching several benchmarks still runs the others */
+	if (arg_num_accumulators > 1 && arg_num_accumulators > bench->max_accumulators) {
+		fprintf(stderr, "Warning: Benchmark %s does not support %d accumulators, skipping it.\n", bench->name, arg_num_accumulators);
+		pthread_attr_destroy(&attr);
+		return EXIT_SUCCESS;
+	}
+
+	if (arg_vector_width > 0 && !bench->vectorized) {
+		fprintf(stderr, "Warning: Benchmark %s has no vector kernels, skipping it.\n", bench->name);
+		pthread_attr_destroy(&attr);
+		return EXIT_SUCCESS;
+	}
+	if (bench->missing_feature != NULL && bench->missing_feature() != NULL) {
+		fprintf(stderr, "Warning: Benchmark %s needs %s, which the CPU does not support, skipping it.\n", bench->name, bench->missing_feature());
+		pthread_attr_destroy(&attr);
+		return EXIT_SUCCESS;
+	}
+	if (bench->vectorized && measure_vector_width() == 0) {
+		fprintf(stderr, "Error: The vector kernels need at least SSE4.1.\n");
+		exit(EXIT_FAILURE);
+	}
+	if (arg_vector_width > cpu_vector_width()) {
+		fprintf(stderr, "Error: The CPU does not support %d-bit vectors.\n", arg_vector_width);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Less output when repeating or sweeping */
+	if (arg_num_repeat > 1 || arg_do_sweep) {
+		quiet_mode = 1;
+	}
+	if (quiet_mode) {
+		measure_flags |= MEASURE_FLAG_NO_PRINT;
+	}
+
+	/* The text segment is shared by every benchmark run in the same process */
+	if (arg_huge_pages && !text_remapped) {
+		remap_text_huge_pages();
+		text_remapped = 1;
+	}
+	if (bench->vectorized && !quiet_mode) {
+		printf("Vector width: %d bits.\n", measure_vector_width());
+	}
+	if (arg_mxcsr_bits && !quiet_mode) {
+		printf("Flush-to-zero: %s, denormals-are-zero: %s.\n", arg_mxcsr_bits & MEASURE_MXCSR_FTZ ? "on" : "off", arg_mxcsr_bits & MEASURE_MXCSR_DAZ ? "on" : "off");
+	}
+	if (arg_huge_pages && !quiet_mode) {
+		printf("Text segment: %lu bytes, %lu bytes on 2 MB pages.\n", text_bytes, text_huge_bytes);
 	}
 
-	/* Print compact power consumption numbers when repeating multiple times */
-	if (arg_do_measure && arg_num_repeat > 1) {
-		for (j = 0; j < arg_num_repeat; j++) {
-			printf("%d,%f,%.0f,%.0f,%f,%f,%.0f,%f,%.0f,%.0f,%f,%f,%.0f\n", arg_num_threads,
-				time_elapsed_normal[j], uops_issued_normal[j], idq_mite_uops_normal[j],
-				pkg_power_normal[j], pp0_power_normal[j], pkg_temp_normal[j],
-				time_elapsed_extreme[j], uops_issued_extreme[j], idq_mite_uops_extreme[j],
-				pkg_power_extreme[j], pp0_power_extreme[j], pkg_temp_extreme[j]);
+	if (arg_do_measure) {
+		perf_events_changed = select_perf_events(bench);
+		if (bench->branch_events && !branch_columns(bench)) {
+			fprintf(stderr, "Warning: -e replaces the branch events of %s, omitting the cost per mispredict and resteer.\n", bench->name);
+		}
+		if (!measure_init_papi(measure_flags)) {
+			fprintf(stderr, "Warning: measure_init_papi failed, disabling measurements.\n");
+			arg_do_measure = 0;
 		}
+		if (!measure_init_thread(&measure_state, measure_flags)) {
+			fprintf(stderr, "Warning: measure_init_thread failed, disabling measurements.\n");
+			arg_do_measure = 0;
+		}
+	}
+
+	/* Allocate data structures for threads */
+	targs = measure_alloc(arg_num_threads * sizeof(*targs));
+	if (targs == NULL) {
+		fprintf(stderr, "Error: measure_alloc failed!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Call initialization hook for every thread structure */
+	for (i = 0; i < arg_num_threads; i++) {
+		/* Copy arguments */
+		targs[i].do_measure = arg_do_measure;
+		targs[i].init = bench->init;
+		rval = pthread_create(&targs[i].thread_id, NULL, measure_benchmark_init_thread, &targs[i]);
+		if (rval != 0) {
+			fprintf(stderr, "Error: pthread_create failed (rval = %d)!\n", rval);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (i = 0; i < arg_num_threads; i++) {
+		rval = pthread_join(targs[i].thread_id, &thread_result);
+		if (rval != 0) {
+			fprintf(stderr, "Warning: pthread_join failed (rval = %d)!\n", rval);
+		}
+	}
+
+	/* Calibration phase */
+	memset(&measure_baseline, 0, sizeof(measure_baseline));
+	if (arg_do_measure && arg_calibration_time > 0 && (arg_benchmark_phase == -1 || arg_benchmark_phase == 0)) {
+		if (arg_cooldown_temp > 0) {
+			phase_cooldown(bench, quiet_mode, targs, attrp);
+		}
+		phase_calibrate(quiet_mode, targs, attrp, &measure_state);
+	}
+	memset(&measure_leakage, 0, sizeof(measure_leakage));
+	if (arg_do_measure && arg_leakage_time > 0 && (arg_benchmark_phase == -1 || arg_benchmark_phase == 0)) {
+		phase_calibrate_leakage(bench, quiet_mode, targs, attrp, &measure_state);
+	}
+
+	// Print CSV-output column names
+	if (arg_do_measure && quiet_mode) {
+		/* The baseline goes into comment lines which are skipped by do-batch-summary.php */
+		printf("# idle_pkg_power=%f,idle_pp0_power=%f,overhead_time=%f,overhead_pkg_energy=%f,overhead_pp0_energy=%f\n",
+		       measure_baseline.idle_pkg_power, measure_baseline.idle_pp0_power,
+		       measure_baseline.overhead_time, measure_baseline.overhead_pkg_energy, measure_baseline.overhead_pp0_energy);
+		printf("# leakage_pkg_intercept=%f,leakage_pkg_slope=%f,leakage_pp0_intercept=%f,leakage_pp0_slope=%f,leakage_points=%d,reference_temp=%d\n",
+		       measure_leakage.pkg_intercept, measure_leakage.pkg_slope, measure_leakage.pp0_intercept, measure_leakage.pp0_slope,
+		       measure_leakage.num_points, arg_reference_temp);
+		if (perf_events_changed) {
+			/* The uops_issued, idq_mite, idq_dsb and idq_ms columns hold these events instead */
+			printf("# perf_events=%s,%s,%s,%s\n", perf_event_1_name, perf_event_2_name, perf_event_3_name, perf_event_4_name);
+		}
+		if (bench->vectorized) {
+			printf("# vector_width=%d\n", measure_vector_width());
+		}
+		if (arg_num_accumulators > 1) {
+			printf("# accumulators=%d\n", arg_num_accumulators);
+		}
+		if (arg_data_pattern) {
+			printf("# data_pattern=%s\n", arg_data_pattern);
+		}
+		if (arg_mxcsr_bits) {
+			printf("# ftz=%d,daz=%d\n", (arg_mxcsr_bits & MEASURE_MXCSR_FTZ) != 0, (arg_mxcsr_bits & MEASURE_MXCSR_DAZ) != 0);
+		}
+		if (arg_huge_pages) {
+			printf("# text_bytes=%lu,text_huge_bytes=%lu,jit_huge_bytes=%lu\n", text_bytes, text_huge_bytes, jit_huge_page_bytes());
+		}
+		if (arg_do_sweep) {
+			printf("%s,", bench->param_name);
+		}
+		printf("num_threads"
+		       ",time_elapsed_normal,uops_issued_normal,idq_mite_normal,idq_dsb_normal,idq_ms_normal,pkg_power_normal,pp0_power_normal,pkg_dyn_power_normal,pp0_dyn_power_normal,pkg_power_tnorm_normal,pp0_power_tnorm_normal,pkg_temp_normal,pkg_temp_avg_normal"
+		       ",time_elapsed_extreme,uops_issued_extreme,idq_mite_extreme,idq_dsb_extreme,idq_ms_extreme,pkg_power_extreme,pp0_power_extreme,pkg_dyn_power_extreme,pp0_dyn_power_extreme,pkg_power_tnorm_extreme,pp0_power_tnorm_extreme,pkg_temp_extreme,pkg_temp_avg_extreme");
+		if (bench->ops_per_iteration > 0) {
+			printf(",ops,pkg_energy_per_op_normal,pkg_dyn_energy_per_op_normal,uops_per_op_normal"
+			       ",pkg_energy_per_op_extreme,pkg_dyn_energy_per_op_extreme,uops_per_op_extreme");
+			if (bench->per_op_counter > 0) {
+				printf(",event%d_per_op_normal,event%d_per_op_extreme", bench->per_op_counter, bench->per_op_counter);
+			}
+		}
+		if (branch_columns(bench)) {
+			printf(",pkg_energy_per_mispredict,wasted_uops_per_mispredict,pkg_energy_per_resteer,wasted_uops_per_resteer");
+		}
+		printf("\n");
 		fflush(stdout);
 	}
 
+	/* Buffers for storing repeated measurements */
+	measure_sample_t *samples_normal = NULL, *samples_extreme = NULL;
+
+	/* Allocate buffers */
+	if (arg_do_measure) {
+		const long buffer_size = arg_num_repeat * sizeof(measure_sample_t);
+		samples_normal = measure_alloc(buffer_size);
+		samples_extreme = measure_alloc(buffer_size);
+	}
+
+	/* Warmup for normal version, also starting from the cooldown temperature */
+	if (arg_benchmark_phase == -1 || arg_benchmark_phase == 1) {
+		if (arg_do_measure && arg_cooldown_temp > 0 && arg_warmup_time > 0) {
+			phase_cooldown(bench, quiet_mode, targs, attrp);
+		}
+		phase_warmup(bench, quiet_mode, bench->normal, targs, attrp);
+	}
+
+	/* Without a sweep the loop below runs once with the default parameter */
+	long sweep_value = arg_sweep_from, param = 0, ntimes = bench->ntimes;
+	double sweep_target_time = 0;
+	char first_point = 1;
+	do {
+		if (arg_do_sweep) {
+			param = phase_set_param(bench, sweep_value, targs);
+			ntimes = phase_sweep_ntimes(bench, param, targs, attrp, &sweep_target_time);
+		}
+
+		/* Normal version, every measured phase starts from the cooldown temperature */
+		if (arg_benchmark_phase == -1 || arg_benchmark_phase == 2) {
+			if (arg_do_measure && arg_cooldown_temp > 0) {
+				phase_cooldown(bench, quiet_mode, targs, attrp);
+			}
+			phase_measure(bench->normal, NULL, ntimes, "normal", samples_normal, quiet_mode, targs, attrp, &measure_state, measure_flags);
+		}
+
+		/* Warmup for extreme version, only before the first sweep point */
+		if (first_point && (arg_benchmark_phase == -1 || arg_benchmark_phase == 3)) {
+			if (!quiet_mode) {
+				printf("\n");
+				printf("========================================================================\n");
+				printf("\n");
+			}
+			if (arg_do_measure && arg_cooldown_temp > 0 && arg_warmup_time > 0) {
+				phase_cooldown(bench, quiet_mode, targs, attrp);
+			}
+			phase_warmup(bench, quiet_mode, bench->extreme, targs, attrp);
+		}
+
+		/* Extreme unrolled version */
+		if (arg_benchmark_phase == -1 || arg_benchmark_phase == 4) {
+			if (arg_do_measure && arg_cooldown_temp > 0) {
+				phase_cooldown(bench, quiet_mode, targs, attrp);
+			}
+			phase_measure(bench->extreme, bench->report, ntimes, "extreme unrolled", samples_extreme, quiet_mode, targs, attrp, &measure_state, measure_flags);
+		}
+
+		/* Print compact power consumption numbers when repeating or sweeping */
+		if (arg_do_measure && quiet_mode) {
+			print_samples(bench, param, ntimes, samples_normal, samples_extreme);
+		}
+
+		/* Next sweep point, making sure the value grows even with a tiny factor */
+		long next_value = arg_sweep_step > 0 ? sweep_value + arg_sweep_step : (long)(sweep_value * arg_sweep_factor);
+		sweep_value = next_value > sweep_value ? next_value : sweep_value + 1;
+		first_point = 0;
+	} while (arg_do_sweep && sweep_value <= arg_sweep_to);
+
 	/* Call cleanup hook for every thread structure */
 	for (i = 0; i < arg_num_threads; i++) {
 		bench->cleanup(targs[i].benchdata);
@@ -1211,18 +2344,8 @@ int measure_main(int argc, char **argv, measure_benchmark_t *bench) {
 
 	/* Clean up */
 	if (arg_do_measure) {
-		free(pkg_power_normal);
-		free(pp0_power_normal);
-		free(pkg_power_extreme);
-		free(pp0_power_extreme);
-		free(time_elapsed_normal);
-		free(time_elapsed_extreme);
-		free(uops_issued_normal);
-		free(uops_issued_extreme);
-		free(idq_mite_uops_normal);
-		free(idq_mite_uops_extreme);
-		free(pkg_temp_normal);
-		free(pkg_temp_extreme);
+		free(samples_normal);
+		free(samples_extreme);
 		measure_cleanup(&measure_state);
 	}
 	free(targs);
@@ -1231,3 +2354,125 @@ int measure_main(int argc, char **argv, measure_benchmark_t *bench) {
 	/* Success */
 	return EXIT_SUCCESS;
 }
+
+/*
+ * Benchmark registry
+ */
+static measure_benchmark_t **registry = NULL;
+static int registry_size = 0;
+static int registry_capacity = 0;
+
+/*
+ * Register a benchmark. Called from constructors before main().
+ */
+int measure_register_benchmark(measure_benchmark_t *bench) {
+	if (registry_size == registry_capacity) {
+		registry_capacity = registry_capacity ? registry_capacity * 2 : 64;
+		registry = realloc(registry, registry_capacity * sizeof(*registry));
+		if (!registry) {
+			fprintf(stderr, "Error: realloc failed!\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	registry[registry_size++] = bench;
+
+	/* Success */
+	return 1;
+}
+
+static int registry_compare(const void *a, const void *b) {
+	const measure_benchmark_t *bench_a = *(measure_benchmark_t * const *)a;
+	const measure_benchmark_t *bench_b = *(measure_benchmark_t * const *)b;
+	return strcmp(bench_a->name, bench_b->name);
+}
+
+/*
+ * Check whether a benchmark name matches any of the glob patterns given with --run.
+ */
+static int registry_matches(const char *name, char **patterns, int num_patterns) {
+	int i = 0;
+	for (i = 0; i < num_patterns; i++) {
+		if (fnmatch(patterns[i], name, 0) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Entry point shared by all benchmark executables.
+ *
+ * Usage: <program> [ --list ] [ --run <glob pattern> ]... [ benchmark options ]
+ *
+ * Without --run, the program must contain exactly one benchmark which is then run.
+ */
+int measure_registry_main(int argc, char **argv) {
+	char **patterns = measure_alloc(argc * sizeof(*patterns));
+	char **bench_argv = measure_alloc((argc + 1) * sizeof(*bench_argv));
+	int num_patterns = 0, bench_argc = 0;
+	char do_list = 0;
+	int i = 0, num_matched = 0;
+	int rval = EXIT_SUCCESS;
+
+	/* Separate the registry options from the benchmark options */
+	bench_argv[bench_argc++] = argv[0];
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--list") == 0) {
+			do_list = 1;
+		}
+		else if (strcmp(argv[i], "--run") == 0) {
+			if (i + 1 < argc) {
+				i++;
+				patterns[num_patterns++] = argv[i];
+			}
+		}
+		else {
+			bench_argv[bench_argc++] = argv[i];
+		}
+	}
+
+	qsort(registry, registry_size, sizeof(*registry), registry_compare);
+
+	if (do_list) {
+		for (i = 0; i < registry_size; i++) {
+			if (num_patterns == 0 || registry_matches(registry[i]->name, patterns, num_patterns)) {
+				printf("%s\n", registry[i]->name);
+			}
+		}
+		free(patterns);
+		free(bench_argv);
+		return EXIT_SUCCESS;
+	}
+
+	if (num_patterns == 0) {
+		if (registry_size != 1) {
+			fprintf(stderr, "Error: %d benchmarks available, select them with --run <pattern> (see --list).\n", registry_size);
+			exit(EXIT_FAILURE);
+		}
+		patterns[num_patterns++] = "*";
+	}
+
+	for (i = 0; i < registry_size; i++) {
+		if (!registry_matches(registry[i]->name, patterns, num_patterns)) {
+			continue;
+		}
+		/* measure_main() modifies the benchmark parameters, so give it a copy */
+		measure_benchmark_t bench = *registry[i];
+		if (registry_size > 1) {
+			printf("# benchmark=%s\n", bench.name);
+			fflush(stdout);
+		}
+		if (measure_main(bench_argc, bench_argv, &bench) != EXIT_SUCCESS) {
+			rval = EXIT_FAILURE;
+		}
+		num_matched++;
+	}
+	if (num_matched == 0) {
+		fprintf(stderr, "Error: No benchmarks match the given patterns.\n");
+		rval = EXIT_FAILURE;
+	}
+
+	free(patterns);
+	free(bench_argv);
+	return rval;
+}
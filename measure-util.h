@@ -27,13 +27,14 @@
 #include <time.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <sys/time.h>
 
 #define millisleep(x)	(usleep((x) * 1000))
 
-/* Assuming that RAND_MAX is 2^31 - 1 */
-#define rand64()	(((unsigned long long)rand() << 62) | ((unsigned long long)rand() << 31) | rand())
-#define rand32()	(((unsigned int)rand() << 31) | rand())
+/* Per-thread generator seeded with -d random:<seed> */
+#define rand64()	((unsigned long long)measure_rand64())
+#define rand32()	((unsigned int)(measure_rand64() >> 32))
 
 #if __x86_64__ || __i386__
 #define HAVE_RDTSC
@@ -56,6 +57,26 @@
 #define MEASURE_FLAG_NO_PRINT	0x01
 #define MEASURE_FLAG_NO_ENERGY	0x02
 
+/* Page size used for the text segment and JIT code with -H */
+#define MEASURE_HUGE_PAGE_SIZE	0x200000UL
+
+/* MXCSR bits set in the worker threads with -Z */
+#define MEASURE_MXCSR_FTZ	0x8000
+#define MEASURE_MXCSR_DAZ	0x0040
+
+/* Largest number of independent accumulators selectable with -A */
+#define MEASURE_MAX_ACCUMULATORS	16
+
+/*
+ * Call an inline kernel whose last argument is the number of accumulators with the number given
+ * with -A as a constant, so that the accumulator array of every copy is kept in registers.
+ */
+#define MEASURE_CALL_ACCUMULATORS(kernel, ...) \
+	(arg_num_accumulators == 16 ? kernel(__VA_ARGS__, 16) : \
+	 arg_num_accumulators == 8 ? kernel(__VA_ARGS__, 8) : \
+	 arg_num_accumulators == 4 ? kernel(__VA_ARGS__, 4) : \
+	 arg_num_accumulators == 2 ? kernel(__VA_ARGS__, 2) : kernel(__VA_ARGS__, 1))
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -150,9 +171,12 @@ int measure_init_papi(int flags);
 int measure_init_thread(measure_state_t *state, int flags);
 int measure_start(measure_state_t *s, int flags);
 int measure_stop(measure_state_t *state, int flags);
-int measure_combine_perf_results(measure_state_t *this, measure_state_t *other);
+int measure_combine_perf_results(measure_state_t *state, measure_state_t *other);
 int measure_print(measure_state_t *state, int flags);
 int measure_cleanup(measure_state_t *state);
+double measure_read_pkg_temp(void);
+int measure_open_msr(int core);
+int measure_read_msr(int fd, unsigned msr_offset, uint64_t *value);
 void *measure_alloc(size_t size);
 void *measure_aligned_alloc(size_t size, size_t alignment);
 
@@ -166,12 +190,26 @@ typedef struct {
 } perf_counter_t;
 
 typedef struct {
+	const char *name;
 	int (*init)(void **benchdata);
 	int (*normal)(void *benchdata, long ntimes);
 	int (*extreme)(void *benchdata, long ntimes);
 	int (*cleanup)(void *benchdata);
-	perf_counter_t counters[4]; /* Not yet implemented */
+	perf_counter_t counters[4]; /* Events replacing the default programmable counters, NULL name keeps the default */
 	long ntimes;
+	/* Optional runtime parameter swept with -s. set_param is called in every worker thread and returns the effective value, or a negative value on failure. */
+	long (*set_param)(void *benchdata, long value);
+	const char *param_name;
+	long param_default; /* Parameter value which ntimes was tuned for, or 0 if ntimes does not depend on it */
+	int max_accumulators; /* Largest number of independent accumulators selectable with -A, or 0 if the kernel has a single one */
+	char vectorized; /* Kernel is compiled for every vector width, selected with -V */
+	double ops_per_iteration; /* Operations per iteration of both versions at the default parameter, or 0 if not counted */
+	int per_op_counter; /* Counter (1-4) whose count per operation is appended, or 0 */
+	char branch_events; /* Counters 2-4 hold retired uops, branch mispredicts and front-end resteers, the cost of each is appended */
+	/* Optional, called from the main thread after every measured run of the extreme version with the benchdata of every thread. */
+	void (*report)(void **benchdata, int num_threads);
+	/* Optional, returns the name of a CPU feature the kernels need but the CPU lacks, or NULL. The benchmark is then skipped. */
+	const char *(*missing_feature)(void);
 } measure_benchmark_t;
 
 /*
@@ -184,9 +222,52 @@ extern int  arg_num_threads;
 extern int  arg_num_repeat;
 extern int  arg_warmup_time;
 extern char arg_force_affinity;
+extern int  arg_calibration_time;
+extern int  arg_leakage_time;
+extern int  arg_reference_temp;
+extern int  arg_cooldown_temp;
+extern int  arg_cooldown_band;
+extern char arg_cooldown_filler;
+extern char arg_do_sweep;
+extern long arg_sweep_from;
+extern long arg_sweep_to;
+extern double arg_sweep_factor;
+extern long arg_sweep_step;
+extern const char *arg_input_file;
+extern const char *arg_perf_events[4];
+extern char arg_huge_pages;
+extern int  arg_num_accumulators;
+extern int  arg_vector_width;
+extern const char *arg_data_pattern;
+extern int  arg_mxcsr_bits;
 
 int measure_main(int argc, char **argv, measure_benchmark_t *bench);
 
+/*
+ * Vector width in bits for the vectorized kernels: the width given with -V, or the widest one supported by the CPU.
+ */
+int measure_vector_width(void);
+
+/*
+ * Fill the kernel inputs with the data pattern selected with -d. The element size is given in bytes,
+ * and the floating point version takes float or double arrays.
+ */
+uint64_t measure_rand64(void);
+void measure_fill_int_array(void *array, long n, size_t size);
+void measure_fill_float_array(void *array, long n, size_t size);
+
+/*
+ * Benchmark registry. Every benchmark registers itself at program startup so that any number of
+ * benchmarks can be linked into the same executable and selected by name.
+ */
+int measure_register_benchmark(measure_benchmark_t *bench);
+int measure_registry_main(int argc, char **argv);
+
+#define MEASURE_REGISTER_BENCHMARK(bench) \
+	static void __attribute__((constructor)) measure_register_##bench(void) { \
+		measure_register_benchmark(&(bench)); \
+	}
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,346 @@
+/*
+ * Instruction mix description language and kernel synthesizer. See mix-synth.h for the file format.
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "mix-synth.h"
+
+/*
+ * Default number of instructions in the normal loop body.
+ */
+#define MIX_DEFAULT_BODY	512
+
+/*
+ * Instruction templates.
+ */
+enum {
+	MIX_ADD = 0, MIX_OR, MIX_ADC, MIX_SBB, MIX_AND, MIX_SUB, MIX_XOR, MIX_CMP, /* same order as jit_alu_t */
+	MIX_IMUL, MIX_SHL, MIX_SHR, MIX_MOV, MIX_NOP,
+	MIX_ADDSD, MIX_SUBSD, MIX_MULSD, MIX_DIVSD
+};
+
+static const char *mix_mnemonics[] = {
+	"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp",
+	"imul", "shl", "shr", "mov", "nop",
+	"addsd", "subsd", "mulsd", "divsd",
+	NULL
+};
+
+/*
+ * Accumulator registers of the chains. Only caller-saved registers are used, rcx, rsi and rdi hold
+ * the loop counters and the array pointer.
+ */
+static const jit_reg_t mix_int_regs[MIX_MAX_CHAINS] = { JIT_RAX, JIT_RDX, JIT_R8, JIT_R9, JIT_R10, JIT_R11 };
+
+static int parse_operand(const char *str, mix_operand_t *operand) {
+	char *end = NULL;
+	if (strcasecmp(str, "acc") == 0) {
+		operand->kind = MIX_OPERAND_ACC;
+	} else if (strcasecmp(str, "next") == 0) {
+		operand->kind = MIX_OPERAND_NEXT;
+	} else if (strcasecmp(str, "xacc") == 0) {
+		operand->kind = MIX_OPERAND_XACC;
+	} else if (strcasecmp(str, "xnext") == 0) {
+		operand->kind = MIX_OPERAND_XNEXT;
+	} else if (strcasecmp(str, "mem") == 0) {
+		operand->kind = MIX_OPERAND_MEM;
+	} else {
+		operand->kind = MIX_OPERAND_IMM;
+		operand->imm = strtoll(str, &end, 0);
+		if (end == str || *end != '\0') {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Emit one instruction template for the given chain. Returns 0 if the operand combination is not supported.
+ */
+static int emit_insn(jit_buffer_t *jit, const mix_t *mix, const mix_insn_t *insn, int chain, long *mem_index) {
+	const mix_operand_t *dst = &insn->operands[0], *src = &insn->operands[1];
+	jit_reg_t acc = mix_int_regs[chain], next = mix_int_regs[(chain + 1) % mix->chains];
+	int xacc = chain, xnext = (chain + 1) % mix->chains;
+	int32_t disp = (int32_t)((*mem_index % MIX_ARRAY_SIZE) * 8);
+
+	if (insn->opcode == MIX_NOP) {
+		long len = insn->num_operands > 0 ? dst->imm : 1;
+		if (insn->num_operands > 1 || (insn->num_operands == 1 && dst->kind != MIX_OPERAND_IMM) || len < 1 || len > 15) {
+			return 0;
+		}
+		jit_nop_single(jit, len);
+		return 1;
+	}
+
+	if (insn->opcode >= MIX_ADDSD) {
+		static const jit_sse_t sse_ops[] = { JIT_SSE_ADD, JIT_SSE_SUB, JIT_SSE_MUL, JIT_SSE_DIV };
+		jit_sse_t op = sse_ops[insn->opcode - MIX_ADDSD];
+		if (insn->num_operands != 2 || dst->kind != MIX_OPERAND_XACC) {
+			return 0;
+		}
+		if (src->kind == MIX_OPERAND_XACC) {
+			jit_sse_xmm_xmm(jit, op, xacc, xacc);
+		} else if (src->kind == MIX_OPERAND_XNEXT) {
+			jit_sse_xmm_xmm(jit, op, xacc, xnext);
+		} else if (src->kind == MIX_OPERAND_MEM) {
+			jit_sse_xmm_mem(jit, op, xacc, JIT_RSI, disp);
+			(*mem_index)++;
+		} else {
+			return 0;
+		}
+		return 1;
+	}
+
+	/* Integer instructions always write the accumulator of the chain */
+	if (insn->num_operands < 2 || dst->kind != MIX_OPERAND_ACC) {
+		return 0;
+	}
+	switch (insn->opcode) {
+		case MIX_IMUL:
+			if (insn->num_operands == 3) {
+				if (insn->operands[2].kind != MIX_OPERAND_IMM || (src->kind != MIX_OPERAND_ACC && src->kind != MIX_OPERAND_NEXT)) {
+					return 0;
+				}
+				jit_imul_r64_r64_imm32(jit, acc, src->kind == MIX_OPERAND_ACC ? acc : next, (int32_t)insn->operands[2].imm);
+			} else if (src->kind == MIX_OPERAND_ACC || src->kind == MIX_OPERAND_NEXT) {
+				jit_imul_r64_r64(jit, acc, src->kind == MIX_OPERAND_ACC ? acc : next);
+			} else if (src->kind == MIX_OPERAND_MEM) {
+				jit_imul_r64_mem(jit, acc, JIT_RSI, disp);
+				(*mem_index)++;
+			} else {
+				return 0;
+			}
+			return 1;
+		case MIX_SHL:
+		case MIX_SHR:
+			if (insn->num_operands != 2 || src->kind != MIX_OPERAND_IMM) {
+				return 0;
+			}
+			if (insn->opcode == MIX_SHL) {
+				jit_shl_r64_imm8(jit, acc, (uint8_t)src->imm);
+			} else {
+				jit_shr_r64_imm8(jit, acc, (uint8_t)src->imm);
+			}
+			return 1;
+		case MIX_MOV:
+			if (insn->num_operands != 2) {
+				return 0;
+			}
+			if (src->kind == MIX_OPERAND_IMM) {
+				jit_mov_r64_imm64(jit, acc, (uint64_t)src->imm);
+			} else if (src->kind == MIX_OPERAND_NEXT) {
+				jit_mov_r64_r64(jit, acc, next);
+			} else {
+				return 0;
+			}
+			return 1;
+	}
+
+	/* Group 1 arithmetic */
+	if (insn->num_operands != 2) {
+		return 0;
+	}
+	if (src->kind == MIX_OPERAND_ACC || src->kind == MIX_OPERAND_NEXT) {
+		jit_alu_r64_r64(jit, (jit_alu_t)insn->opcode, acc, src->kind == MIX_OPERAND_ACC ? acc : next);
+	} else if (src->kind == MIX_OPERAND_MEM) {
+		jit_alu_r64_mem(jit, (jit_alu_t)insn->opcode, acc, JIT_RSI, disp);
+		(*mem_index)++;
+	} else if (src->kind == MIX_OPERAND_IMM) {
+		jit_alu_r64_imm32(jit, (jit_alu_t)insn->opcode, acc, (int32_t)src->imm);
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Generate the kernel: for (i = 0; i < ntimes; i++) for (j = 0; j < inner_iters; j++) { body }
+ * The body has exactly the requested number of instructions. Returns 0 on failure.
+ */
+int mix_generate(jit_buffer_t *jit, const mix_t *mix, long body, long inner_iters) {
+	long emitted = 0, mem_index = 0;
+	int chain = 0, i = 0, r = 0;
+
+	/* 15 bytes is the longest x86 instruction */
+	if (!jit_alloc(jit, (body * 15 + 4096 + 4095) & ~4095L)) {
+		return 0;
+	}
+
+	/* Initialize accumulators with distinct non-zero values, avoiding denormals in the SSE ones */
+	for (chain = 0; chain < MIX_MAX_CHAINS; chain++) {
+		double value = 1.0 + chain;
+		uint64_t bits = 0;
+		memcpy(&bits, &value, sizeof(bits));
+		jit_mov_r64_imm64(jit, mix_int_regs[chain], bits);
+		jit_movq_xmm_r64(jit, chain, mix_int_regs[chain]);
+		jit_mov_r64_imm64(jit, mix_int_regs[chain], chain + 1);
+	}
+
+	size_t outer = jit_label(jit);
+	jit_mov_r64_imm64(jit, JIT_RCX, inner_iters);
+	size_t inner = jit_label(jit);
+	chain = 0;
+	while (emitted < body) {
+		for (i = 0; i < mix->num_insns && emitted < body; i++) {
+			for (r = 0; r < mix->insns[i].ratio && emitted < body; r++) {
+				if (!emit_insn(jit, mix, &mix->insns[i], chain, &mem_index)) {
+					fprintf(stderr, "Error: Unsupported operands for instruction template %d (%s)!\n", i + 1, mix_mnemonics[mix->insns[i].opcode]);
+					jit_free(jit);
+					return 0;
+				}
+				emitted++;
+			}
+		}
+		chain = (chain + 1) % mix->chains;
+	}
+	jit_dec_r64(jit, JIT_RCX);
+	jit_jnz(jit, inner);
+	jit_dec_r64(jit, JIT_RDI);
+	jit_jnz(jit, outer);
+
+	/* Combine the accumulators into the return value */
+	for (chain = 1; chain < MIX_MAX_CHAINS; chain++) {
+		jit_add_r64_r64(jit, JIT_RAX, mix_int_regs[chain]);
+	}
+	for (chain = 0; chain < MIX_MAX_CHAINS; chain++) {
+		jit_cvttsd2si_r64_xmm(jit, JIT_RCX, chain);
+		jit_add_r64_r64(jit, JIT_RAX, JIT_RCX);
+	}
+	jit_ret(jit);
+	return jit_finalize(jit);
+}
+
+/*
+ * Parse a mix file. Errors are reported with the line number. Returns 0 on failure.
+ */
+int mix_parse_file(const char *path, mix_t *mix) {
+	char line[256];
+	int line_num = 0;
+	FILE *fp = fopen(path, "r");
+
+	if (fp == NULL) {
+		fprintf(stderr, "Error: Could not open mix file \"%s\"!\n", path);
+		return 0;
+	}
+
+	memset(mix, 0, sizeof(*mix));
+	mix->chains = 1;
+	mix->body = MIX_DEFAULT_BODY;
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *tokens[8];
+		int num_tokens = 0, i = 0;
+		char *p = NULL, *saveptr = NULL;
+
+		line_num++;
+		if ((p = strchr(line, '#')) != NULL) {
+			*p = '\0';
+		}
+		/* Operands are separated by commas and/or whitespace */
+		for (p = strtok_r(line, " \t\r\n,", &saveptr); p != NULL && num_tokens < 8; p = strtok_r(NULL, " \t\r\n,", &saveptr)) {
+			tokens[num_tokens++] = p;
+		}
+		if (num_tokens == 0) {
+			continue;
+		}
+
+		if (strcasecmp(tokens[0], "chains") == 0 || strcasecmp(tokens[0], "body") == 0) {
+			long value = num_tokens == 2 ? atol(tokens[1]) : 0;
+			if (value <= 0 || (strcasecmp(tokens[0], "chains") == 0 && value > MIX_MAX_CHAINS)) {
+				fprintf(stderr, "Error: %s:%d: Invalid value for %s.\n", path, line_num, tokens[0]);
+				fclose(fp);
+				return 0;
+			}
+			if (strcasecmp(tokens[0], "chains") == 0) {
+				mix->chains = value;
+			} else {
+				mix->body = value;
+			}
+			continue;
+		}
+
+		/* Instruction template */
+		if (mix->num_insns >= MIX_MAX_INSNS) {
+			fprintf(stderr, "Error: %s:%d: Too many instruction templates.\n", path, line_num);
+			fclose(fp);
+			return 0;
+		}
+		mix_insn_t *insn = &mix->insns[mix->num_insns];
+		insn->opcode = -1;
+		insn->ratio = 1;
+		for (i = 0; mix_mnemonics[i] != NULL; i++) {
+			if (strcasecmp(tokens[0], mix_mnemonics[i]) == 0) {
+				insn->opcode = i;
+			}
+		}
+		if (insn->opcode < 0) {
+			fprintf(stderr, "Error: %s:%d: Unknown instruction \"%s\".\n", path, line_num, tokens[0]);
+			fclose(fp);
+			return 0;
+		}
+		for (i = 1; i < num_tokens; i++) {
+			if (tokens[i][0] == 'x' && isdigit((unsigned char)tokens[i][1])) {
+				insn->ratio = atoi(tokens[i] + 1);
+			} else if (insn->num_operands >= 3 || !parse_operand(tokens[i], &insn->operands[insn->num_operands++])) {
+				fprintf(stderr, "Error: %s:%d: Invalid operand \"%s\".\n", path, line_num, tokens[i]);
+				fclose(fp);
+				return 0;
+			}
+		}
+		if (insn->ratio <= 0) {
+			fprintf(stderr, "Error: %s:%d: Invalid ratio.\n", path, line_num);
+			fclose(fp);
+			return 0;
+		}
+		mix->num_insns++;
+	}
+	fclose(fp);
+
+	if (mix->num_insns == 0) {
+		fprintf(stderr, "Error: %s: No instruction templates.\n", path);
+		return 0;
+	}
+
+	/* Check every template by generating a body which contains each of them at least once */
+	jit_buffer_t scratch;
+	long group = 0;
+	int i = 0;
+	for (i = 0; i < mix->num_insns; i++) {
+		group += mix->insns[i].ratio;
+	}
+	if (!mix_generate(&scratch, mix, group, 1)) {
+		return 0;
+	}
+	jit_free(&scratch);
+
+	/* Success */
+	return 1;
+}
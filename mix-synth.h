@@ -0,0 +1,101 @@
+/*
+ * Instruction mix description language and kernel synthesizer. A mix file describes the loop body of a
+ * benchmark as a list of instruction templates, and the synthesizer generates the kernel with the JIT.
+ *
+ * File format, one directive or instruction template per line, '#' starts a comment:
+ *
+ *   chains <n>         Number of independent dependency chains, 1-6 (default 1)
+ *   body <n>           Instructions in the normal loop body (default 512), the extreme body has twice as many
+ *   <insn> [x<ratio>]  Instruction template, repeated <ratio> times in a row (default 1)
+ *
+ * The templates form a group which is repeated until the body is full. Consecutive groups use
+ * consecutive chains, so the instructions of one group depend on each other but not on the other chains.
+ * The normal and extreme kernels execute the same number of instructions per outer iteration: the extreme
+ * body runs MIX_INSNS_PER_ITERATION / (2 * body) times (at least once) and the normal body twice as often.
+ *
+ * Operands: acc and next are the integer accumulators of the current and the next chain, xacc and xnext
+ * the SSE accumulators, mem is the next element of a 16 kB array, and numbers are immediates.
+ *
+ *   add, or, adc, sbb, and, sub, xor, cmp   acc, acc|next|mem|<imm32>
+ *   imul                                    acc, acc|next|mem  or  acc, acc|next, <imm32>
+ *   shl, shr                                acc, <imm8>
+ *   mov                                     acc, next|<imm64>
+ *   nop                                     [<length 1-15>]
+ *   addsd, subsd, mulsd, divsd              xacc, xacc|xnext|mem
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MIX_SYNTH_H
+#define MIX_SYNTH_H
+
+#include "x86-jit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIX_MAX_INSNS	64
+#define MIX_MAX_CHAINS	6
+
+/*
+ * Number of elements in the array accessed through mem operands.
+ */
+#define MIX_ARRAY_SIZE	2048
+
+/*
+ * Instructions executed per outer iteration. The inner loop runs the body enough times to reach about this.
+ */
+#define MIX_INSNS_PER_ITERATION	4096
+
+typedef enum {
+	MIX_OPERAND_NONE = 0, MIX_OPERAND_ACC, MIX_OPERAND_NEXT, MIX_OPERAND_XACC, MIX_OPERAND_XNEXT, MIX_OPERAND_MEM, MIX_OPERAND_IMM
+} mix_operand_kind_t;
+
+typedef struct {
+	mix_operand_kind_t kind;
+	long long imm;
+} mix_operand_t;
+
+typedef struct {
+	int opcode;
+	int num_operands;
+	mix_operand_t operands[3];
+	int ratio;
+} mix_insn_t;
+
+typedef struct {
+	mix_insn_t insns[MIX_MAX_INSNS];
+	int num_insns;
+	int chains;
+	long body;
+} mix_t;
+
+int mix_parse_file(const char *path, mix_t *mix);
+int mix_generate(jit_buffer_t *jit, const mix_t *mix, long body, long inner_iters);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MIX_SYNTH_H */
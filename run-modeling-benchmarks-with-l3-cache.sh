@@ -3,72 +3,75 @@
 # Benchmark cases suitable for modeling
 
 function run_benchmarks {
-	./idq-bench-float32-add "$@"
-	./idq-bench-float32-addmul "$@"
-	./idq-bench-float32-array-l1-add "$@"
-	./idq-bench-float32-array-l1-addmul "$@"
-	./idq-bench-float32-array-l1-scale "$@"
-	./idq-bench-float32-array-l1-schoenauer "$@"
-	./idq-bench-float32-array-l1-triad "$@"
-	./idq-bench-float32-array-l2-add "$@"
-	./idq-bench-float32-array-l2-addmul "$@"
-	./idq-bench-float32-array-l2-scale "$@"
-	./idq-bench-float32-array-l2-schoenauer "$@"
-	./idq-bench-float32-array-l2-triad "$@"
-	./idq-bench-float32-array-l3-add "$@"
-	./idq-bench-float32-array-l3-addmul "$@"
-	./idq-bench-float32-array-l3-scale "$@"
-	./idq-bench-float32-array-l3-schoenauer "$@"
-	./idq-bench-float32-array-l3-triad "$@"
-	./idq-bench-float32-scale "$@"
-	./idq-bench-float32-schoenauer "$@"
-	./idq-bench-float-add "$@"
-	./idq-bench-float-addmul "$@"
-	./idq-bench-float-array-l1-add "$@"
-	./idq-bench-float-array-l1-addmul "$@"
-	./idq-bench-float-array-l1-scale "$@"
-	./idq-bench-float-array-l1-schoenauer "$@"
-	./idq-bench-float-array-l1-triad "$@"
-	./idq-bench-float-array-l2-add "$@"
-	./idq-bench-float-array-l2-addmul "$@"
-	./idq-bench-float-array-l2-scale "$@"
-	./idq-bench-float-array-l2-schoenauer "$@"
-	./idq-bench-float-array-l2-triad "$@"
-	./idq-bench-float-array-l3-add "$@"
-	./idq-bench-float-array-l3-addmul "$@"
-	./idq-bench-float-array-l3-scale "$@"
-	./idq-bench-float-array-l3-schoenauer "$@"
-	./idq-bench-float-array-l3-triad "$@"
-	./idq-bench-float-scale "$@"
-	./idq-bench-float-schoenauer "$@"
-	./idq-bench-int32-array-l1-addmulshift "$@"
-	./idq-bench-int32-array-l1-addmulshift2 "$@"
-	./idq-bench-int32-array-l2-addmulshift "$@"
-	./idq-bench-int32-array-l2-addmulshift2 "$@"
-	./idq-bench-int32-array-l3-addmulshift "$@"
-	./idq-bench-int32-array-l3-addmulshift2 "$@"
-	./idq-bench-int-algo-prng "$@"
-	./idq-bench-int-algo-prng-multi2 "$@"
-	./idq-bench-int-algo-prng-multi3 "$@"
-	./idq-bench-int-algo-prng-multi3b "$@"
-	./idq-bench-int-algo-prng-multi3c "$@"
-	./idq-bench-int-algo-prng-multi4 "$@"
-	./idq-bench-int-algo-prng-multi4b "$@"
-	./idq-bench-int-array-l1-addmul "$@"
-	./idq-bench-int-array-l1-addmulshift "$@"
-	./idq-bench-int-array-l1-addmulshift2 "$@"
-	./idq-bench-int-array-l1-addmulshift3 "$@"
-	./idq-bench-int-array-l1-addmulshift4 "$@"
-	./idq-bench-int-array-l2-addmul "$@"
-	./idq-bench-int-array-l2-addmulshift "$@"
-	./idq-bench-int-array-l2-addmulshift2 "$@"
-	./idq-bench-int-array-l2-addmulshift3 "$@"
-	./idq-bench-int-array-l2-addmulshift4 "$@"
-	./idq-bench-int-array-l3-addmul "$@"
-	./idq-bench-int-array-l3-addmulshift "$@"
-	./idq-bench-int-array-l3-addmulshift2 "$@"
-	./idq-bench-int-array-l3-addmulshift3 "$@"
-	./idq-bench-int-array-l3-addmulshift4 "$@"
+	# All benchmarks run in the same process
+	./idq-bench \
+		--run float32-add \
+		--run float32-addmul \
+		--run float32-array-l1-add \
+		--run float32-array-l1-addmul \
+		--run float32-array-l1-scale \
+		--run float32-array-l1-schoenauer \
+		--run float32-array-l1-triad \
+		--run float32-array-l2-add \
+		--run float32-array-l2-addmul \
+		--run float32-array-l2-scale \
+		--run float32-array-l2-schoenauer \
+		--run float32-array-l2-triad \
+		--run float32-array-l3-add \
+		--run float32-array-l3-addmul \
+		--run float32-array-l3-scale \
+		--run float32-array-l3-schoenauer \
+		--run float32-array-l3-triad \
+		--run float32-scale \
+		--run float32-schoenauer \
+		--run float-add \
+		--run float-addmul \
+		--run float-array-l1-add \
+		--run float-array-l1-addmul \
+		--run float-array-l1-scale \
+		--run float-array-l1-schoenauer \
+		--run float-array-l1-triad \
+		--run float-array-l2-add \
+		--run float-array-l2-addmul \
+		--run float-array-l2-scale \
+		--run float-array-l2-schoenauer \
+		--run float-array-l2-triad \
+		--run float-array-l3-add \
+		--run float-array-l3-addmul \
+		--run float-array-l3-scale \
+		--run float-array-l3-schoenauer \
+		--run float-array-l3-triad \
+		--run float-scale \
+		--run float-schoenauer \
+		--run int32-array-l1-addmulshift \
+		--run int32-array-l1-addmulshift2 \
+		--run int32-array-l2-addmulshift \
+		--run int32-array-l2-addmulshift2 \
+		--run int32-array-l3-addmulshift \
+		--run int32-array-l3-addmulshift2 \
+		--run int-algo-prng \
+		--run int-algo-prng-multi2 \
+		--run int-algo-prng-multi3 \
+		--run int-algo-prng-multi3b \
+		--run int-algo-prng-multi3c \
+		--run int-algo-prng-multi4 \
+		--run int-algo-prng-multi4b \
+		--run int-array-l1-addmul \
+		--run int-array-l1-addmulshift \
+		--run int-array-l1-addmulshift2 \
+		--run int-array-l1-addmulshift3 \
+		--run int-array-l1-addmulshift4 \
+		--run int-array-l2-addmul \
+		--run int-array-l2-addmulshift \
+		--run int-array-l2-addmulshift2 \
+		--run int-array-l2-addmulshift3 \
+		--run int-array-l2-addmulshift4 \
+		--run int-array-l3-addmul \
+		--run int-array-l3-addmulshift \
+		--run int-array-l3-addmulshift2 \
+		--run int-array-l3-addmulshift3 \
+		--run int-array-l3-addmulshift4 \
+		"$@"
 }
 
 # Run benchmarks with 1 thread for ~11 seconds
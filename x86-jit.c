@@ -0,0 +1,436 @@
+/*
+ * Minimal x86-64 machine code emitter for generating benchmark kernels at runtime.
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "measure-util.h"
+#include "x86-jit.h"
+
+/*
+ * Allocate a writable code buffer of the given size. Returns 0 on failure. With -H, buffers of
+ * at least 2 MB are rounded up to whole 2 MB pages and backed by transparent huge pages. Without
+ * -H, the buffer is kept on 4 kB pages even when transparent huge pages are always enabled.
+ */
+int jit_alloc(jit_buffer_t *jit, size_t size) {
+	size_t reserve = size;
+	unsigned char *aligned = NULL;
+
+	if (arg_huge_pages && size >= MEASURE_HUGE_PAGE_SIZE) {
+		size = (size + MEASURE_HUGE_PAGE_SIZE - 1) & ~(MEASURE_HUGE_PAGE_SIZE - 1);
+		reserve = size + MEASURE_HUGE_PAGE_SIZE;
+	}
+	jit->code = mmap(NULL, reserve, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->code == MAP_FAILED) {
+		fprintf(stderr, "Error: mmap of %zu bytes for JIT code failed!\n", reserve);
+		jit->code = NULL;
+		return 0;
+	}
+	if (reserve > size) {
+		/* Trim the reservation to an aligned buffer */
+		aligned = (unsigned char *)(((uintptr_t)jit->code + MEASURE_HUGE_PAGE_SIZE - 1) & ~(MEASURE_HUGE_PAGE_SIZE - 1));
+		if (aligned > jit->code) {
+			munmap(jit->code, aligned - jit->code);
+		}
+		munmap(aligned + size, jit->code + reserve - (aligned + size));
+		jit->code = aligned;
+		if (madvise(jit->code, size, MADV_HUGEPAGE) != 0) {
+			fprintf(stderr, "Warning: madvise(MADV_HUGEPAGE) for JIT code failed.\n");
+		}
+	} else if (!arg_huge_pages) {
+		/* Fails only without transparent huge page support, which is fine here */
+		madvise(jit->code, size, MADV_NOHUGEPAGE);
+	}
+	jit->size = size;
+	jit->len = 0;
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Make the buffer executable. No more code can be emitted after this.
+ */
+int jit_finalize(jit_buffer_t *jit) {
+	if (mprotect(jit->code, jit->size, PROT_READ | PROT_EXEC) != 0) {
+		fprintf(stderr, "Error: mprotect of JIT code failed!\n");
+		return 0;
+	}
+
+	/* Success */
+	return 1;
+}
+
+void jit_free(jit_buffer_t *jit) {
+	if (jit->code) {
+		munmap(jit->code, jit->size);
+	}
+	jit->code = NULL;
+	jit->size = 0;
+	jit->len = 0;
+}
+
+/*
+ * Current position, usable as a branch target.
+ */
+size_t jit_label(jit_buffer_t *jit) {
+	return jit->len;
+}
+
+void jit_emit_bytes(jit_buffer_t *jit, const void *bytes, size_t len) {
+	if (jit->len + len > jit->size) {
+		fprintf(stderr, "Error: JIT code buffer of %zu bytes overflowed!\n", jit->size);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(jit->code + jit->len, bytes, len);
+	jit->len += len;
+}
+
+void jit_emit_u8(jit_buffer_t *jit, uint8_t value) {
+	jit_emit_bytes(jit, &value, 1);
+}
+
+void jit_emit_u32(jit_buffer_t *jit, uint32_t value) {
+	/* x86 is little-endian, like the host */
+	jit_emit_bytes(jit, &value, 4);
+}
+
+void jit_emit_u64(jit_buffer_t *jit, uint64_t value) {
+	jit_emit_bytes(jit, &value, 8);
+}
+
+/*
+ * REX prefix with the W bit and the high bits of the register fields.
+ */
+static void emit_rex(jit_buffer_t *jit, int w, int reg, int base) {
+	jit_emit_u8(jit, 0x40 | (w ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((base & 8) ? 0x01 : 0));
+}
+
+/*
+ * Register-direct ModRM byte.
+ */
+static void emit_modrm_reg(jit_buffer_t *jit, int reg, int rm) {
+	jit_emit_u8(jit, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/*
+ * Memory ModRM with a 32-bit displacement. The displacement size is fixed so that every instance
+ * of an instruction template has the same length regardless of the offset.
+ */
+static void emit_modrm_disp32(jit_buffer_t *jit, int reg, jit_reg_t base, int32_t disp) {
+	jit_emit_u8(jit, 0x80 | ((reg & 7) << 3) | (base & 7));
+	if ((base & 7) == JIT_RSP) {
+		/* SIB byte without an index */
+		jit_emit_u8(jit, 0x24);
+	}
+	jit_emit_u32(jit, (uint32_t)disp);
+}
+
+/*
+ * 16-bit operand size forms. The imm16 form has a length-changing prefix, the imm8 form does not.
+ */
+void jit_alu_r16_imm16(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, int16_t imm) {
+	jit_emit_u8(jit, 0x66);
+	if (dst & 8) {
+		emit_rex(jit, 0, 0, dst);
+	}
+	jit_emit_u8(jit, 0x81);
+	emit_modrm_reg(jit, op, dst);
+	jit_emit_u8(jit, (uint16_t)imm & 0xff);
+	jit_emit_u8(jit, (uint16_t)imm >> 8);
+}
+
+void jit_alu_r16_imm8(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, int8_t imm) {
+	jit_emit_u8(jit, 0x66);
+	if (dst & 8) {
+		emit_rex(jit, 0, 0, dst);
+	}
+	jit_emit_u8(jit, 0x83);
+	emit_modrm_reg(jit, op, dst);
+	jit_emit_u8(jit, (uint8_t)imm);
+}
+
+void jit_xchg_r64_r64(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src) {
+	emit_rex(jit, 1, src, dst);
+	jit_emit_u8(jit, 0x87);
+	emit_modrm_reg(jit, src, dst);
+}
+
+void jit_mov_r64_imm64(jit_buffer_t *jit, jit_reg_t dst, uint64_t imm) {
+	emit_rex(jit, 1, 0, dst);
+	jit_emit_u8(jit, 0xb8 + (dst & 7));
+	jit_emit_u64(jit, imm);
+}
+
+void jit_mov_r64_r64(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src) {
+	emit_rex(jit, 1, src, dst);
+	jit_emit_u8(jit, 0x89);
+	emit_modrm_reg(jit, src, dst);
+}
+
+void jit_xor_r32_r32(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src) {
+	if ((dst | src) & 8) {
+		emit_rex(jit, 0, src, dst);
+	}
+	jit_emit_u8(jit, 0x31);
+	emit_modrm_reg(jit, src, dst);
+}
+
+void jit_alu_r64_r64(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, jit_reg_t src) {
+	emit_rex(jit, 1, src, dst);
+	jit_emit_u8(jit, op * 8 + 0x01);
+	emit_modrm_reg(jit, src, dst);
+}
+
+void jit_alu_r64_imm32(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, int32_t imm) {
+	emit_rex(jit, 1, 0, dst);
+	jit_emit_u8(jit, 0x81);
+	emit_modrm_reg(jit, op, dst);
+	jit_emit_u32(jit, (uint32_t)imm);
+}
+
+void jit_alu_r64_mem(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, jit_reg_t base, int32_t disp) {
+	emit_rex(jit, 1, dst, base);
+	jit_emit_u8(jit, op * 8 + 0x03);
+	emit_modrm_disp32(jit, dst, base, disp);
+}
+
+void jit_add_r64_r64(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src) {
+	jit_alu_r64_r64(jit, JIT_ALU_ADD, dst, src);
+}
+
+void jit_add_r64_imm32(jit_buffer_t *jit, jit_reg_t dst, int32_t imm) {
+	jit_alu_r64_imm32(jit, JIT_ALU_ADD, dst, imm);
+}
+
+void jit_add_r64_mem(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t base, int32_t disp) {
+	jit_alu_r64_mem(jit, JIT_ALU_ADD, dst, base, disp);
+}
+
+void jit_shl_r64_imm8(jit_buffer_t *jit, jit_reg_t reg, uint8_t imm) {
+	emit_rex(jit, 1, 0, reg);
+	jit_emit_u8(jit, 0xc1);
+	emit_modrm_reg(jit, 4, reg);
+	jit_emit_u8(jit, imm);
+}
+
+void jit_shr_r64_imm8(jit_buffer_t *jit, jit_reg_t reg, uint8_t imm) {
+	emit_rex(jit, 1, 0, reg);
+	jit_emit_u8(jit, 0xc1);
+	emit_modrm_reg(jit, 5, reg);
+	jit_emit_u8(jit, imm);
+}
+
+void jit_imul_r64_mem(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t base, int32_t disp) {
+	emit_rex(jit, 1, dst, base);
+	jit_emit_u8(jit, 0x0f);
+	jit_emit_u8(jit, 0xaf);
+	emit_modrm_disp32(jit, dst, base, disp);
+}
+
+void jit_imul_r64_r64(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src) {
+	emit_rex(jit, 1, dst, src);
+	jit_emit_u8(jit, 0x0f);
+	jit_emit_u8(jit, 0xaf);
+	emit_modrm_reg(jit, dst, src);
+}
+
+void jit_imul_r64_r64_imm32(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src, int32_t imm) {
+	emit_rex(jit, 1, dst, src);
+	jit_emit_u8(jit, 0x69);
+	emit_modrm_reg(jit, dst, src);
+	jit_emit_u32(jit, (uint32_t)imm);
+}
+
+void jit_dec_r64(jit_buffer_t *jit, jit_reg_t reg) {
+	emit_rex(jit, 1, 0, reg);
+	jit_emit_u8(jit, 0xff);
+	emit_modrm_reg(jit, 1, reg);
+}
+
+void jit_push_r64(jit_buffer_t *jit, jit_reg_t reg) {
+	if (reg & 8) {
+		emit_rex(jit, 0, 0, reg);
+	}
+	jit_emit_u8(jit, 0x50 + (reg & 7));
+}
+
+void jit_pop_r64(jit_buffer_t *jit, jit_reg_t reg) {
+	if (reg & 8) {
+		emit_rex(jit, 0, 0, reg);
+	}
+	jit_emit_u8(jit, 0x58 + (reg & 7));
+}
+
+void jit_ret(jit_buffer_t *jit) {
+	jit_emit_u8(jit, 0xc3);
+}
+
+/*
+ * Recommended multi-byte NOP sequences from the Intel optimization manual.
+ */
+static const unsigned char nop_table[9][9] = {
+	{ 0 },
+	{ 0x90 },
+	{ 0x66, 0x90 },
+	{ 0x0f, 0x1f, 0x00 },
+	{ 0x0f, 0x1f, 0x40, 0x00 },
+	{ 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+	{ 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+	{ 0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00 },
+	{ 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+};
+
+void jit_nop(jit_buffer_t *jit, size_t len) {
+	while (len > 0) {
+		size_t n = len > 8 ? 8 : len;
+		jit_emit_bytes(jit, nop_table[n], n);
+		len -= n;
+	}
+}
+
+/*
+ * A single NOP instruction of 1-15 bytes. Lengths above 8 use redundant operand size prefixes.
+ */
+void jit_nop_single(jit_buffer_t *jit, size_t len) {
+	while (len > 8) {
+		jit_emit_u8(jit, 0x66);
+		len--;
+	}
+	jit_emit_bytes(jit, nop_table[len], len);
+}
+
+/*
+ * Mandatory prefix, optional REX and two-byte opcode of an SSE instruction.
+ */
+static void emit_sse_op(jit_buffer_t *jit, uint8_t prefix, int w, int reg, int rm, uint8_t opcode) {
+	jit_emit_u8(jit, prefix);
+	if (w || ((reg | rm) & 8)) {
+		emit_rex(jit, w, reg, rm);
+	}
+	jit_emit_u8(jit, 0x0f);
+	jit_emit_u8(jit, opcode);
+}
+
+void jit_xorpd_xmm_xmm(jit_buffer_t *jit, int dst, int src) {
+	emit_sse_op(jit, 0x66, 0, dst, src, 0x57);
+	emit_modrm_reg(jit, dst, src);
+}
+
+void jit_addsd_xmm_mem(jit_buffer_t *jit, int dst, jit_reg_t base, int32_t disp) {
+	jit_sse_xmm_mem(jit, JIT_SSE_ADD, dst, base, disp);
+}
+
+void jit_sse_xmm_xmm(jit_buffer_t *jit, jit_sse_t op, int dst, int src) {
+	emit_sse_op(jit, 0xf2, 0, dst, src, op);
+	emit_modrm_reg(jit, dst, src);
+}
+
+void jit_sse_xmm_mem(jit_buffer_t *jit, jit_sse_t op, int dst, jit_reg_t base, int32_t disp) {
+	emit_sse_op(jit, 0xf2, 0, dst, base, op);
+	emit_modrm_disp32(jit, dst, base, disp);
+}
+
+void jit_cvttsd2si_r64_xmm(jit_buffer_t *jit, jit_reg_t dst, int src) {
+	emit_sse_op(jit, 0xf2, 1, dst, src, 0x2c);
+	emit_modrm_reg(jit, dst, src);
+}
+
+void jit_movq_xmm_r64(jit_buffer_t *jit, int dst, jit_reg_t src) {
+	emit_sse_op(jit, 0x66, 1, dst, src, 0x6e);
+	emit_modrm_reg(jit, dst, src);
+}
+
+/*
+ * Packed arithmetic on xmm registers in the legacy SSE, VEX and EVEX encodings.
+ * The operation is the same, only the instruction length and the prefixes differ.
+ */
+void jit_sse_packed_xmm_xmm(jit_buffer_t *jit, jit_sse_t op, int dst, int src) {
+	emit_sse_op(jit, 0x66, 0, dst, src, op);
+	emit_modrm_reg(jit, dst, src);
+}
+
+/*
+ * VEX.128.66.0F, the two-byte VEX prefix is used when possible unless vex3 is set.
+ */
+void jit_vex_packed_xmm_xmm(jit_buffer_t *jit, jit_sse_t op, int dst, int src1, int src2, int vex3) {
+	uint8_t vvvv_l_pp = ((~src1 & 15) << 3) | 0x01;
+	if (!vex3 && !(src2 & 8)) {
+		jit_emit_u8(jit, 0xc5);
+		jit_emit_u8(jit, ((dst & 8) ? 0 : 0x80) | vvvv_l_pp);
+	} else {
+		jit_emit_u8(jit, 0xc4);
+		jit_emit_u8(jit, ((dst & 8) ? 0 : 0x80) | 0x40 | ((src2 & 8) ? 0 : 0x20) | 0x01);
+		jit_emit_u8(jit, vvvv_l_pp);
+	}
+	jit_emit_u8(jit, op);
+	emit_modrm_reg(jit, dst, src2);
+}
+
+/*
+ * EVEX.128.66.0F.W1 without masking, requires AVX-512VL.
+ */
+void jit_evex_packed_xmm_xmm(jit_buffer_t *jit, jit_sse_t op, int dst, int src1, int src2) {
+	jit_emit_u8(jit, 0x62);
+	jit_emit_u8(jit, ((dst & 8) ? 0 : 0x80) | 0x40 | ((src2 & 8) ? 0 : 0x20) | 0x10 | 0x01);
+	jit_emit_u8(jit, 0x80 | ((~src1 & 15) << 3) | 0x04 | 0x01);
+	jit_emit_u8(jit, 0x08);
+	jit_emit_u8(jit, op);
+	emit_modrm_reg(jit, dst, src2);
+}
+
+void jit_vzeroupper(jit_buffer_t *jit) {
+	jit_emit_u8(jit, 0xc5);
+	jit_emit_u8(jit, 0xf8);
+	jit_emit_u8(jit, 0x77);
+}
+
+/*
+ * Branches always use the rel32 form so that the loop structure does not change size with the body.
+ */
+void jit_jnz(jit_buffer_t *jit, size_t target) {
+	jit_emit_u8(jit, 0x0f);
+	jit_emit_u8(jit, 0x85);
+	jit_emit_u32(jit, (uint32_t)(int32_t)((long)target - (long)(jit->len + 4)));
+}
+
+void jit_jz(jit_buffer_t *jit, size_t target) {
+	jit_emit_u8(jit, 0x0f);
+	jit_emit_u8(jit, 0x84);
+	jit_emit_u32(jit, (uint32_t)(int32_t)((long)target - (long)(jit->len + 4)));
+}
+
+void jit_jmp(jit_buffer_t *jit, size_t target) {
+	jit_emit_u8(jit, 0xe9);
+	jit_emit_u32(jit, (uint32_t)(int32_t)((long)target - (long)(jit->len + 4)));
+}
+
+void jit_call(jit_buffer_t *jit, size_t target) {
+	jit_emit_u8(jit, 0xe8);
+	jit_emit_u32(jit, (uint32_t)(int32_t)((long)target - (long)(jit->len + 4)));
+}
@@ -0,0 +1,135 @@
+/*
+ * Minimal x86-64 machine code emitter for generating benchmark kernels at runtime.
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef X86_JIT_H
+#define X86_JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * General purpose registers in encoding order.
+ */
+typedef enum {
+	JIT_RAX = 0, JIT_RCX, JIT_RDX, JIT_RBX, JIT_RSP, JIT_RBP, JIT_RSI, JIT_RDI,
+	JIT_R8, JIT_R9, JIT_R10, JIT_R11, JIT_R12, JIT_R13, JIT_R14, JIT_R15
+} jit_reg_t;
+
+/*
+ * Group 1 arithmetic operations in encoding order.
+ */
+typedef enum {
+	JIT_ALU_ADD = 0, JIT_ALU_OR, JIT_ALU_ADC, JIT_ALU_SBB, JIT_ALU_AND, JIT_ALU_SUB, JIT_ALU_XOR, JIT_ALU_CMP
+} jit_alu_t;
+
+/*
+ * Double precision SSE2 arithmetic opcodes, shared by the scalar and packed forms. PXOR only has
+ * the packed form, and its EVEX form is VPXORQ.
+ */
+typedef enum {
+	JIT_SSE_ADD = 0x58, JIT_SSE_MUL = 0x59, JIT_SSE_SUB = 0x5c, JIT_SSE_DIV = 0x5e, JIT_SSE_PXOR = 0xef
+} jit_sse_t;
+
+/*
+ * Code buffer. The memory is writable while emitting and executable after jit_finalize().
+ */
+typedef struct {
+	unsigned char *code;
+	size_t size;
+	size_t len;
+} jit_buffer_t;
+
+/*
+ * Generated kernels follow the System V calling convention: the first argument is the number
+ * of outer iterations and the second one points to the data array.
+ */
+typedef long (*jit_kernel_t)(long ntimes, void *data);
+
+int jit_alloc(jit_buffer_t *jit, size_t size);
+int jit_finalize(jit_buffer_t *jit);
+void jit_free(jit_buffer_t *jit);
+size_t jit_label(jit_buffer_t *jit);
+
+/* Raw bytes */
+void jit_emit_u8(jit_buffer_t *jit, uint8_t value);
+void jit_emit_u32(jit_buffer_t *jit, uint32_t value);
+void jit_emit_u64(jit_buffer_t *jit, uint64_t value);
+void jit_emit_bytes(jit_buffer_t *jit, const void *bytes, size_t len);
+
+/* Integer instructions */
+void jit_alu_r64_r64(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, jit_reg_t src);
+void jit_alu_r64_imm32(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, int32_t imm);
+void jit_alu_r64_mem(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, jit_reg_t base, int32_t disp);
+void jit_shl_r64_imm8(jit_buffer_t *jit, jit_reg_t reg, uint8_t imm);
+void jit_shr_r64_imm8(jit_buffer_t *jit, jit_reg_t reg, uint8_t imm);
+void jit_imul_r64_mem(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t base, int32_t disp);
+void jit_alu_r16_imm16(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, int16_t imm);
+void jit_alu_r16_imm8(jit_buffer_t *jit, jit_alu_t op, jit_reg_t dst, int8_t imm);
+void jit_xchg_r64_r64(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src);
+void jit_mov_r64_imm64(jit_buffer_t *jit, jit_reg_t dst, uint64_t imm);
+void jit_mov_r64_r64(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src);
+void jit_xor_r32_r32(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src);
+void jit_add_r64_r64(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src);
+void jit_add_r64_imm32(jit_buffer_t *jit, jit_reg_t dst, int32_t imm);
+void jit_add_r64_mem(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t base, int32_t disp);
+void jit_imul_r64_r64(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src);
+void jit_imul_r64_r64_imm32(jit_buffer_t *jit, jit_reg_t dst, jit_reg_t src, int32_t imm);
+void jit_dec_r64(jit_buffer_t *jit, jit_reg_t reg);
+void jit_push_r64(jit_buffer_t *jit, jit_reg_t reg);
+void jit_pop_r64(jit_buffer_t *jit, jit_reg_t reg);
+void jit_ret(jit_buffer_t *jit);
+void jit_nop(jit_buffer_t *jit, size_t len);
+void jit_nop_single(jit_buffer_t *jit, size_t len);
+
+/* Scalar double precision SSE2 instructions, xmm registers 0-15 */
+void jit_xorpd_xmm_xmm(jit_buffer_t *jit, int dst, int src);
+void jit_addsd_xmm_mem(jit_buffer_t *jit, int dst, jit_reg_t base, int32_t disp);
+void jit_sse_xmm_xmm(jit_buffer_t *jit, jit_sse_t op, int dst, int src);
+void jit_sse_xmm_mem(jit_buffer_t *jit, jit_sse_t op, int dst, jit_reg_t base, int32_t disp);
+void jit_cvttsd2si_r64_xmm(jit_buffer_t *jit, jit_reg_t dst, int src);
+void jit_movq_xmm_r64(jit_buffer_t *jit, int dst, jit_reg_t src);
+
+/* Packed arithmetic, xmm registers 0-15 */
+void jit_sse_packed_xmm_xmm(jit_buffer_t *jit, jit_sse_t op, int dst, int src);
+void jit_vex_packed_xmm_xmm(jit_buffer_t *jit, jit_sse_t op, int dst, int src1, int src2, int vex3);
+void jit_evex_packed_xmm_xmm(jit_buffer_t *jit, jit_sse_t op, int dst, int src1, int src2);
+void jit_vzeroupper(jit_buffer_t *jit);
+
+/* Branches, the target is a label returned by jit_label() */
+void jit_jnz(jit_buffer_t *jit, size_t target);
+void jit_jz(jit_buffer_t *jit, size_t target);
+void jit_jmp(jit_buffer_t *jit, size_t target);
+void jit_call(jit_buffer_t *jit, size_t target);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* X86_JIT_H */
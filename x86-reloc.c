@@ -0,0 +1,351 @@
+/*
+ * Relocation of x86-64 machine code. Copies a compiled or generated kernel to an arbitrary address and
+ * fixes up the PC-relative references which point outside of the copied code.
+ *
+ * The instruction length decoder covers the general purpose, x87, SSE, VEX and EVEX encodings
+ * produced by GCC for the benchmark kernels. It does not try to validate the instructions.
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "x86-reloc.h"
+
+/*
+ * Maximum length of an x86 instruction.
+ */
+#define MAX_INSN_LENGTH	15
+
+/*
+ * Maximum distance of the relocated code from the original, so that rel32 fixups always fit.
+ */
+#define MAX_RELOC_DISTANCE	0x40000000L
+
+static int is_legacy_prefix(unsigned char byte) {
+	switch (byte) {
+		case 0x26: case 0x2e: case 0x36: case 0x3e: case 0x64: case 0x65:
+		case 0x66: case 0x67: case 0xf0: case 0xf2: case 0xf3:
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * ModRM presence for the one-byte opcode map in 64-bit mode.
+ */
+static int has_modrm_map0(unsigned char op) {
+	if (op < 0x40) {
+		return (op & 7) < 4;
+	}
+	switch (op) {
+		case 0x63: case 0x69: case 0x6b:
+		case 0xc0: case 0xc1: case 0xc6: case 0xc7:
+		case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+		case 0xf6: case 0xf7: case 0xfe: case 0xff:
+			return 1;
+	}
+	return (op >= 0x80 && op <= 0x8f) || (op >= 0xd8 && op <= 0xdf);
+}
+
+/*
+ * ModRM presence for the two-byte (0F) opcode map.
+ */
+static int has_modrm_map1(unsigned char op) {
+	switch (op) {
+		case 0x05: case 0x06: case 0x07: case 0x08: case 0x09: case 0x0b: case 0x0e:
+		case 0x77: case 0xa0: case 0xa1: case 0xa2: case 0xa8: case 0xa9: case 0xaa:
+			return 0;
+	}
+	return !(op >= 0x30 && op <= 0x37) && !(op >= 0x80 && op <= 0x8f) && !(op >= 0xc8 && op <= 0xcf);
+}
+
+/*
+ * Immediates with an imm8 operand in the two-byte (0F) opcode map.
+ */
+static int has_imm8_map1(unsigned char op) {
+	switch (op) {
+		case 0x70: case 0x71: case 0x72: case 0x73:
+		case 0xa4: case 0xac: case 0xba: case 0xc2: case 0xc4: case 0xc5: case 0xc6:
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Decode the length of one instruction and the location of its PC-relative field, if any.
+ * Returns 0 if the instruction could not be decoded.
+ */
+int reloc_decode(const unsigned char *code, size_t avail, reloc_insn_t *insn) {
+	size_t pos = 0;
+	int opsize16 = 0, addr32 = 0, rex_w = 0;
+	int map = 0, has_modrm = 0, imm_size = 0, rel_size = 0;
+	unsigned char op = 0;
+
+	insn->length = 0;
+	insn->rel_offset = -1;
+	insn->rel_size = 0;
+	if (avail > MAX_INSN_LENGTH) {
+		avail = MAX_INSN_LENGTH;
+	}
+
+	/* Legacy prefixes */
+	while (pos < avail && is_legacy_prefix(code[pos])) {
+		if (code[pos] == 0x66) opsize16 = 1;
+		if (code[pos] == 0x67) addr32 = 1;
+		pos++;
+	}
+
+	/* REX prefix */
+	if (pos < avail && (code[pos] & 0xf0) == 0x40) {
+		rex_w = (code[pos] & 0x08) != 0;
+		pos++;
+	}
+	/* REX.W takes precedence over the operand-size override */
+	if (rex_w) {
+		opsize16 = 0;
+	}
+	if (pos >= avail) {
+		return 0;
+	}
+
+	op = code[pos++];
+	if (op == 0xc5 || op == 0xc4 || op == 0x62) {
+		/* VEX and EVEX prefixes, which are never LDS/LES/BOUND in 64-bit mode */
+		if (op == 0xc5) {
+			map = 1;
+			pos += 1;
+		} else if (op == 0xc4) {
+			if (pos >= avail) return 0;
+			map = code[pos] & 0x1f;
+			pos += 2;
+		} else {
+			if (pos >= avail) return 0;
+			map = code[pos] & 0x07;
+			pos += 3;
+		}
+		if (pos >= avail) {
+			return 0;
+		}
+		op = code[pos++];
+		has_modrm = !(map == 1 && op == 0x77); /* vzeroupper and vzeroall */
+		if (map == 3 || (map == 1 && has_imm8_map1(op))) {
+			imm_size = 1;
+		}
+	} else if (op == 0x0f) {
+		if (pos >= avail) {
+			return 0;
+		}
+		op = code[pos++];
+		if (op == 0x38 || op == 0x3a) {
+			map = op == 0x38 ? 2 : 3;
+			if (pos >= avail) return 0;
+			op = code[pos++];
+			has_modrm = 1;
+			imm_size = map == 3 ? 1 : 0;
+		} else {
+			map = 1;
+			has_modrm = has_modrm_map1(op);
+			if (has_imm8_map1(op)) {
+				imm_size = 1;
+			} else if (op >= 0x80 && op <= 0x8f) {
+				rel_size = 4; /* jcc rel32 */
+			}
+		}
+	} else {
+		int imm_z = opsize16 ? 2 : 4;
+		has_modrm = has_modrm_map0(op);
+		if (op < 0x40 && (op & 7) == 4) {
+			imm_size = 1;
+		} else if (op < 0x40 && (op & 7) == 5) {
+			imm_size = imm_z;
+		} else if (op >= 0x70 && op <= 0x7f) {
+			rel_size = 1; /* jcc rel8 */
+		} else if (op >= 0xe0 && op <= 0xe3) {
+			rel_size = 1; /* loop, jrcxz */
+		} else if (op >= 0xb0 && op <= 0xb7) {
+			imm_size = 1;
+		} else if (op >= 0xb8 && op <= 0xbf) {
+			imm_size = rex_w ? 8 : imm_z;
+		} else if (op >= 0xa0 && op <= 0xa3) {
+			imm_size = addr32 ? 4 : 8; /* moffs */
+		} else if (op >= 0xe4 && op <= 0xe7) {
+			imm_size = 1;
+		} else {
+			switch (op) {
+				case 0x6a: case 0x6b: case 0x80: case 0x83: case 0xa8:
+				case 0xc0: case 0xc1: case 0xc6: case 0xcd:
+					imm_size = 1;
+					break;
+				case 0x68: case 0x69: case 0x81: case 0xa9: case 0xc7:
+					imm_size = imm_z;
+					break;
+				case 0xc2: case 0xca:
+					imm_size = 2;
+					break;
+				case 0xc8:
+					imm_size = 3;
+					break;
+				case 0xe8: case 0xe9:
+					rel_size = 4; /* call, jmp rel32 */
+					break;
+				case 0xeb:
+					rel_size = 1; /* jmp rel8 */
+					break;
+			}
+		}
+	}
+
+	/* ModRM, SIB and displacement */
+	if (has_modrm) {
+		if (pos >= avail) {
+			return 0;
+		}
+		unsigned char modrm = code[pos++];
+		int mod = modrm >> 6, reg = (modrm >> 3) & 7, rm = modrm & 7;
+		if (map == 0 && (op == 0xf6 || op == 0xf7) && reg < 2) {
+			/* test has an immediate, the other group 3 instructions do not */
+			imm_size = op == 0xf6 ? 1 : (opsize16 ? 2 : 4);
+		}
+		if (mod != 3) {
+			if (rm == 4) {
+				if (pos >= avail) return 0;
+				if (mod == 0 && (code[pos] & 7) == 5) {
+					pos += 4;
+				}
+				pos++;
+			} else if (mod == 0 && rm == 5) {
+				/* RIP-relative */
+				insn->rel_offset = pos;
+				insn->rel_size = 4;
+				pos += 4;
+			}
+			if (mod == 1) pos += 1;
+			if (mod == 2) pos += 4;
+		}
+	}
+
+	/* Immediate or branch offset */
+	if (rel_size > 0) {
+		insn->rel_offset = pos;
+		insn->rel_size = rel_size;
+		pos += rel_size;
+	}
+	pos += imm_size;
+	if (pos > avail) {
+		return 0;
+	}
+	insn->length = pos;
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Allocate writable memory within rel32 reach of the given address. Returns NULL on failure.
+ */
+void *reloc_alloc_near(size_t size, const void *near) {
+	uintptr_t base = (uintptr_t)near & ~(uintptr_t)0xffff;
+	long i = 0;
+
+	for (i = 1; i < 64; i++) {
+		/* Try above the code first, then below */
+		uintptr_t hint = (i & 1) ? base + (i / 2 + 1) * 0x1000000UL : base - (i / 2) * 0x1000000UL;
+		void *buffer = mmap((void *)hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buffer == MAP_FAILED) {
+			continue;
+		}
+		long distance = (long)((uintptr_t)buffer - (uintptr_t)near);
+		if (distance < MAX_RELOC_DISTANCE && distance > -MAX_RELOC_DISTANCE) {
+			return buffer;
+		}
+		munmap(buffer, size);
+	}
+	fprintf(stderr, "Error: Could not allocate relocation buffer near %p!\n", near);
+	return NULL;
+}
+
+void reloc_free(void *buffer, size_t size) {
+	if (buffer) {
+		munmap(buffer, size);
+	}
+}
+
+/*
+ * Copy code and fix up the PC-relative references leaving the copied range. References inside
+ * the range keep their offsets. Returns 0 if the code cannot be relocated.
+ */
+int reloc_copy(unsigned char *dst, const unsigned char *src, size_t len) {
+	size_t pos = 0;
+
+	memcpy(dst, src, len);
+	while (pos < len) {
+		reloc_insn_t insn;
+		if (!reloc_decode(src + pos, len - pos, &insn)) {
+			fprintf(stderr, "Error: Could not decode instruction at offset %zu of the relocated code!\n", pos);
+			return 0;
+		}
+		if (insn.rel_offset >= 0) {
+			long end = pos + insn.length;
+			long disp = 0;
+			if (insn.rel_size == 4) {
+				int32_t disp32 = 0;
+				memcpy(&disp32, src + pos + insn.rel_offset, 4);
+				disp = disp32;
+			} else {
+				disp = (int8_t)src[pos + insn.rel_offset];
+			}
+			long target = end + disp;
+			if (target < 0 || target >= (long)len) {
+				long new_disp = (long)((intptr_t)(src + target) - (intptr_t)(dst + end));
+				if (insn.rel_size != 4 || new_disp > INT32_MAX || new_disp < INT32_MIN) {
+					fprintf(stderr, "Error: Reference at offset %zu of the relocated code is out of reach!\n", pos);
+					return 0;
+				}
+				int32_t disp32 = (int32_t)new_disp;
+				memcpy(dst + pos + insn.rel_offset, &disp32, 4);
+			}
+		}
+		pos += insn.length;
+	}
+
+	/* Success */
+	return 1;
+}
+
+/*
+ * Make the relocated code executable.
+ */
+int reloc_protect(void *buffer, size_t size) {
+	if (mprotect(buffer, size, PROT_READ | PROT_EXEC) != 0) {
+		fprintf(stderr, "Error: mprotect of relocated code failed!\n");
+		return 0;
+	}
+
+	/* Success */
+	return 1;
+}
@@ -0,0 +1,65 @@
+/*
+ * Relocation of x86-64 machine code. Copies a compiled or generated kernel to an arbitrary address and
+ * fixes up the PC-relative references which point outside of the copied code.
+ *
+ * Author: Mikael Hirki <mikael.hirki@gmail.com>
+ *
+ * Copyright (c) 2015 Helsinki Institute of Physics
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef X86_RELOC_H
+#define X86_RELOC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Decoded instruction boundaries.
+ */
+typedef struct {
+	size_t length;
+	int rel_offset; /* Offset of a RIP-relative displacement or branch offset, or -1 if none */
+	int rel_size;   /* Size of that field in bytes (1 or 4) */
+} reloc_insn_t;
+
+/*
+ * Place kernels into their own sections so that their code can be located with the __start_ and
+ * __stop_ symbols generated by the linker. The section name must be a valid C identifier.
+ */
+#define RELOC_KERNEL(name) __attribute__((section(#name), noinline, used))
+#define RELOC_DECLARE_SECTION(name) \
+	extern const unsigned char __start_##name[]; \
+	extern const unsigned char __stop_##name[];
+
+int reloc_decode(const unsigned char *code, size_t avail, reloc_insn_t *insn);
+void *reloc_alloc_near(size_t size, const void *near);
+void reloc_free(void *buffer, size_t size);
+int reloc_copy(unsigned char *dst, const unsigned char *src, size_t len);
+int reloc_protect(void *buffer, size_t size);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* X86_RELOC_H */